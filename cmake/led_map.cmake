@@ -0,0 +1,59 @@
+# Generates led_map_generated.h for a target from the CONFIG_ZBOARD_LAYOUT_* and CONFIG_ZBOARD_WIRING_* options
+# (see Kconfig). Used by both the firmware and the host build so they always share the same LED map.
+#   zboard_generate_led_map(<target> [LAYOUT_RUNTIME])
+# LAYOUT_RUNTIME builds in every layout, as CONFIG_ZBOARD_LAYOUT_RUNTIME does.
+
+set(ZBOARD_ROOT_DIR ${CMAKE_CURRENT_LIST_DIR}/..)
+
+if(NOT Python3_EXECUTABLE)
+    find_package(Python3 REQUIRED COMPONENTS Interpreter)
+endif()
+
+function(zboard_generate_led_map target)
+    cmake_parse_arguments(ARG "LAYOUT_RUNTIME" "" "" ${ARGN})
+    set(gen_dir ${CMAKE_CURRENT_BINARY_DIR}/${target}_generated)
+    set(output ${gen_dir}/led_map_generated.h)
+    set(script ${ZBOARD_ROOT_DIR}/scripts/gen_led_map.py)
+    file(MAKE_DIRECTORY ${gen_dir})
+
+    set(args --output ${output})
+    set(depends ${script})
+    if(CONFIG_ZBOARD_LAYOUT_MINI)
+        list(APPEND args --layout mini)
+    elseif(CONFIG_ZBOARD_LAYOUT_CUSTOM)
+        list(APPEND args --layout custom --rows ${CONFIG_ZBOARD_LAYOUT_ROWS} --cols ${CONFIG_ZBOARD_LAYOUT_COLS})
+        if(CONFIG_ZBOARD_LAYOUT_NUMBERING_COLUMNS)
+            list(APPEND args --numbering columns)
+        elseif(CONFIG_ZBOARD_LAYOUT_NUMBERING_ROWS)
+            list(APPEND args --numbering rows)
+        endif()
+    endif()
+    if(CONFIG_ZBOARD_LAYOUT_RUNTIME OR ARG_LAYOUT_RUNTIME)
+        list(APPEND args --all-layouts)
+    endif()
+    if(CONFIG_ZBOARD_WIRING_FIRST_LED_RIGHT)
+        list(APPEND args --first-led-right)
+    endif()
+    if(CONFIG_ZBOARD_WIRING_FIRST_LED_BOTTOM)
+        list(APPEND args --first-led-bottom)
+    endif()
+    if(CONFIG_ZBOARD_WIRING_LEDS_SKIP_FIRST_COLUMN)
+        list(APPEND args --skip "${CONFIG_ZBOARD_WIRING_LEDS_SKIP_FIRST_COLUMN}")
+    endif()
+    if(CONFIG_ZBOARD_WIRING_CUSTOM_MAP)
+        get_filename_component(custom_map ${CONFIG_ZBOARD_WIRING_CUSTOM_MAP} ABSOLUTE BASE_DIR ${ZBOARD_ROOT_DIR})
+        list(APPEND args --custom-map ${custom_map})
+        list(APPEND depends ${custom_map})
+    endif()
+
+    add_custom_command(
+        OUTPUT ${output}
+        COMMAND ${Python3_EXECUTABLE} ${script} ${args}
+        DEPENDS ${depends}
+        COMMENT "Generating LED map"
+        VERBATIM
+    )
+    add_custom_target(${target}_led_map DEPENDS ${output})
+    add_dependencies(${target} ${target}_led_map)
+    target_include_directories(${target} PRIVATE ${gen_dir})
+endfunction()
@@ -0,0 +1,436 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+
+#include <zephyr/drivers/uart.h>
+#include <zephyr/logging/log.h>
+
+#include "ble_link.h"
+#include "compositor.h"
+#include "latency_stats.h"
+#include "led_patterns.h"
+#include "problem_cache.h"
+#include "problem_library.h"
+#include "rx_ring.h"
+#include "strip_power.h"
+
+// Host benchmark / regression harness for the parse -> map -> render path
+// Replays recorded NUS byte streams through the mock UART in BLE-sized chunks, runs the queued work
+// items the way the system workqueue would, and reports throughput, render latency and strip traffic.
+// With -m the stream is sent by that many BLE clients at once instead, each chunk from each client in turn.
+// With -w each chunk also queues that many microseconds of other system workqueue work (Bluetooth,
+// logging), to show how long parsing and rendering wait to run. zboard_bench_sysq is the same harness
+// built without CONFIG_ZBOARD_RENDER_WORKQUEUE, to compare against rendering on the system workqueue.
+// With -i the virtual clock moves on that many milliseconds after each chunk, as if the wall sat idle,
+// so that timers fire, e.g. to switch the strip off while it's dark.
+// The output checksum folds in what the strip shows after every rendered problem, so it must not change
+// when the render path is optimised. Before replaying, the bench also checks that the receive ring breaks
+// the input at every overrun and disconnect.
+//
+// Usage: ./zboard_bench [-n iterations] [-c chunk_bytes] [-m ble_clients] [-w load_us] [-i idle_ms]
+//                       [-e expected_checksum] [-v] [stream files...]
+
+#define DEFAULT_ITERATIONS 100
+#define DEFAULT_CHUNK_BYTES 20 // payload of a default (23 byte MTU) ATT write
+
+void drainInput(struct k_work *work);
+void renderProblem(struct k_work *work);
+void input_cb(const struct device *dev, void *user_data);
+int inputs_init(void);
+void inputs_get_stats(rx_ring_stats_t *total);
+
+typedef struct sampleList
+{
+    uint64_t *ns;
+    size_t count;
+    size_t capacity;
+} sample_list_t;
+
+typedef struct benchResults
+{
+    uint64_t bytes;
+    uint64_t parseNs;
+    uint64_t renderNs;
+    uint32_t renders;
+    uint32_t checksum;
+    sample_list_t renderSamples;   // time spent in renderProblem()
+    sample_list_t latencySamples;  // chunk containing the final '#' arriving -> renderProblem() returning
+    sample_list_t parseQueueSamples;  // drainInput() queued -> starting to run
+    sample_list_t renderQueueSamples; // renderProblem() queued -> starting to run
+} bench_results_t;
+
+static void addSample(sample_list_t *list, uint64_t ns)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->ns = realloc(list->ns, list->capacity * sizeof(list->ns[0]));
+        if (!list->ns)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(2);
+        }
+    }
+    list->ns[list->count++] = ns;
+}
+
+static int compareSamples(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const sample_list_t *list, int pct)
+{
+    if (list->count == 0)
+    {
+        return 0;
+    }
+    size_t idx = (list->count * pct) / 100;
+    return list->ns[idx < list->count ? idx : list->count - 1];
+}
+
+static uint8_t *loadStream(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        fprintf(stderr, "Unable to open stream %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    if (!data || fread(data, 1, size, f) != (size_t)size)
+    {
+        fprintf(stderr, "Unable to read stream %s\n", path);
+        fclose(f);
+        free(data);
+        return NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+static uint64_t loadNs = 0;
+static int idleMs = 0; // Virtual time the wall sits idle after each chunk
+static struct k_work loadWork;
+
+// Stands in for the Bluetooth and logging work that shares the system workqueue
+static void systemLoad(struct k_work *work)
+{
+    uint64_t end = host_time_ns() + loadNs;
+    while (host_time_ns() < end)
+    {
+    }
+}
+
+// Stores len copies of c in the ring
+static void putRun(rx_ring_t *ring, char c, size_t len)
+{
+    uint8_t data[CONFIG_ZBOARD_RX_RING_SIZE];
+    memset(data, c, len);
+    rx_ring_put(ring, data, len);
+}
+
+// Drains the ring, checking that it breaks after each of the expected runs of one character and nowhere else
+static bool drainRuns(rx_ring_t *ring, const char *chars, const size_t *lens, int numRuns)
+{
+    int run = 0;
+    size_t got = 0;
+    for (;;)
+    {
+        const uint8_t *data;
+        size_t len = rx_ring_peek(ring, &data);
+        for (size_t i = 0; i < len; i++)
+        {
+            if (run >= numRuns || data[i] != chars[run])
+            {
+                return false;
+            }
+        }
+        got += len;
+        if (rx_ring_consume(ring, len))
+        {
+            if (got != lens[run])
+            {
+                return false;
+            }
+            run++;
+            got = 0;
+        }
+        else if (len == 0)
+        {
+            return run == numRuns && got == 0;
+        }
+    }
+}
+
+// Two overruns and a disconnect before the parser gets to the first of them: each must still break the
+// input, so that the bytes either side of a gap are never parsed as one problem
+static bool checkRxRingBreaks(void)
+{
+    static rx_ring_t ring;
+    const uint8_t *data;
+    putRun(&ring, 'a', CONFIG_ZBOARD_RX_RING_SIZE);
+    putRun(&ring, 'x', 2); // Overrun
+    rx_ring_consume(&ring, MIN(rx_ring_peek(&ring, &data), 256));
+    putRun(&ring, 'b', 256);
+    putRun(&ring, 'y', 2); // Overrun
+    rx_ring_consume(&ring, MIN(rx_ring_peek(&ring, &data), 256));
+    putRun(&ring, 'c', 256);
+    rx_ring_mark_break(&ring);
+    const char chars[] = {'a', 'b', 'c'};
+    const size_t lens[] = {CONFIG_ZBOARD_RX_RING_SIZE - 512, 256, 256};
+    return drainRuns(&ring, chars, lens, ARRAY_SIZE(lens)) && ring.stats.overruns == 2 &&
+           ring.stats.bytesDropped == 4;
+}
+
+// Same setup as main() in zboard.c, minus settings, advertising and the startup pattern
+static void benchInit(void)
+{
+    inputs_init();
+    led_patterns_init();
+    k_work_init(&loadWork, systemLoad);
+
+    led_map_init(STRIP_LENGTH);
+    compositor_init();
+    led_output_init();
+#ifdef CONFIG_ZBOARD_PROBLEM_LIBRARY
+    problem_library_init();
+#endif
+
+    uart_irq_callback_set(DEVICE_DT_GET(DT_ALIAS(zboard_input)), input_cb);
+    uart_irq_rx_enable(DEVICE_DT_GET(DT_ALIAS(zboard_input)));
+}
+
+// Runs everything queued, attributing the time to parsing or rendering
+static void runPendingWork(bench_results_t *res, uint64_t arrivedNs)
+{
+    struct k_work *work;
+    while ((work = host_work_next()) != NULL)
+    {
+        uint64_t mockNs = host_strip_stats.mockNs;
+        uint64_t start = host_time_ns();
+        work->handler(work);
+        uint64_t end = host_time_ns() - (host_strip_stats.mockNs - mockNs);
+        if (work->handler == drainInput)
+        {
+            res->parseNs += end - start;
+            addSample(&res->parseQueueSamples, start - work->submitted_ns);
+        }
+        else if (work->handler == renderProblem)
+        {
+            res->renderNs += end - start;
+            addSample(&res->renderQueueSamples, start - work->submitted_ns);
+            res->renders++;
+            addSample(&res->renderSamples, end - start);
+            addSample(&res->latencySamples, end - arrivedNs);
+            res->checksum = (res->checksum ^ host_strip_checksum()) * 16777619u;
+        }
+    }
+
+    // Replies sent back to the client are shown with -v
+    uint8_t reply[256];
+    size_t replyLen;
+    while ((replyLen = host_uart_take_tx(reply, sizeof(reply))) > 0)
+    {
+        if (host_log_level > 0)
+        {
+            fwrite(reply, 1, replyLen, stdout);
+        }
+    }
+}
+
+// Sends the stream over the UART, or from each of numClients BLE clients in turn if numClients > 0
+static void replay(const uint8_t *data, size_t len, size_t chunk, int numClients, bench_results_t *res)
+{
+    for (size_t pos = 0; pos < len; pos += chunk)
+    {
+        size_t n = (len - pos) < chunk ? (len - pos) : chunk;
+        for (int client = 0; client < MAX(numClients, 1); client++)
+        {
+            uint64_t arrived = host_time_ns();
+            if (numClients > 0)
+            {
+                host_nus_inject(client, &data[pos], n);
+            }
+            else
+            {
+                host_uart_inject(&data[pos], n);
+            }
+            if (loadNs)
+            {
+                k_work_submit(&loadWork);
+            }
+            runPendingWork(res, arrived);
+            if (idleMs)
+            {
+                k_sleep(K_MSEC(idleMs));
+                runPendingWork(res, host_time_ns());
+            }
+            res->bytes += n;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = DEFAULT_ITERATIONS;
+    size_t chunk = DEFAULT_CHUNK_BYTES;
+    int numClients = 0;
+    bool checkExpected = false;
+    uint32_t expected = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:m:w:i:e:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'c':
+            chunk = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            numClients = atoi(optarg);
+            break;
+        case 'w':
+            loadNs = strtoull(optarg, NULL, 0) * 1000;
+            break;
+        case 'i':
+            idleMs = atoi(optarg);
+            break;
+        case 'e':
+            checkExpected = true;
+            expected = strtoul(optarg, NULL, 16);
+            break;
+        case 'v':
+            host_log_level++;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n iterations] [-c chunk_bytes] [-m ble_clients] [-w load_us] [-i idle_ms] "
+                            "[-e expected_checksum] [-v] [stream files...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iterations < 1 || chunk < 1)
+    {
+        fprintf(stderr, "Iterations and chunk size must be positive\n");
+        return 2;
+    }
+    if (numClients < 0 || numClients > CONFIG_BT_MAX_CONN)
+    {
+        fprintf(stderr, "Between 0 (UART) and %d BLE clients are supported\n", CONFIG_BT_MAX_CONN);
+        return 2;
+    }
+
+    const char *defaultStreams[] = {HOST_DEFAULT_STREAM};
+    const char **streams = (optind < argc) ? (const char **)&argv[optind] : defaultStreams;
+    int numStreams = (optind < argc) ? (argc - optind) : 1;
+
+    if (!checkRxRingBreaks())
+    {
+        printf("FAIL: rx ring lost a break\n");
+        return 1;
+    }
+    benchInit();
+    host_strip_reset();
+
+    bench_results_t res = {.checksum = 2166136261u};
+    for (int s = 0; s < numStreams; s++)
+    {
+        size_t len;
+        uint8_t *data = loadStream(streams[s], &len);
+        if (!data)
+        {
+            return 2;
+        }
+        for (int i = 0; i < iterations; i++)
+        {
+            replay(data, len, chunk, numClients, &res);
+        }
+        free(data);
+    }
+
+    qsort(res.renderSamples.ns, res.renderSamples.count, sizeof(uint64_t), compareSamples);
+    qsort(res.latencySamples.ns, res.latencySamples.count, sizeof(uint64_t), compareSamples);
+    qsort(res.parseQueueSamples.ns, res.parseQueueSamples.count, sizeof(uint64_t), compareSamples);
+    qsort(res.renderQueueSamples.ns, res.renderQueueSamples.count, sizeof(uint64_t), compareSamples);
+
+    printf("Replayed %d stream(s) x %d iteration(s), %zu byte chunks", numStreams, iterations, chunk);
+    if (numClients > 0)
+    {
+        printf(" from %d BLE client(s)", numClients);
+    }
+    if (loadNs)
+    {
+        printf(", %llu us of other work per chunk", (unsigned long long)(loadNs / 1000));
+    }
+    printf(", rendering on the %s workqueue\n", IS_ENABLED(CONFIG_ZBOARD_RENDER_WORKQUEUE) ? "render" : "system");
+    printf("  parse:   %10llu chars      %12.0f chars/sec\n", (unsigned long long)res.bytes,
+           res.parseNs ? res.bytes * 1e9 / res.parseNs : 0.0);
+    printf("  render:  %10u problems   %12.0f problems/sec\n", res.renders,
+           res.renderNs ? res.renders * 1e9 / res.renderNs : 0.0);
+    printf("  render latency   p50 %8.2f us   p99 %8.2f us\n", percentile(&res.renderSamples, 50) / 1e3,
+           percentile(&res.renderSamples, 99) / 1e3);
+    printf("  end-to-end       p50 %8.2f us   p99 %8.2f us\n", percentile(&res.latencySamples, 50) / 1e3,
+           percentile(&res.latencySamples, 99) / 1e3);
+    printf("  queued   parse p50 %8.2f us   p99 %8.2f us   render p50 %8.2f us   p99 %8.2f us\n",
+           percentile(&res.parseQueueSamples, 50) / 1e3, percentile(&res.parseQueueSamples, 99) / 1e3,
+           percentile(&res.renderQueueSamples, 50) / 1e3, percentile(&res.renderQueueSamples, 99) / 1e3);
+    printf("  strip:   %10u updates    %10llu bytes    %8.1f bytes/problem\n", host_strip_stats.updates,
+           (unsigned long long)host_strip_stats.bytesSent,
+           res.renders ? (double)host_strip_stats.bytesSent / res.renders : 0.0);
+    strip_power_stats_t power;
+    strip_power_get_stats(&power);
+    printf("  power:   %10llu ms lit    %10llu ms dark  %8llu ms off   %u switch-ons, %u updates while off\n",
+           (unsigned long long)power.stateMs[STRIP_POWER_LIT], (unsigned long long)power.stateMs[STRIP_POWER_DARK],
+           (unsigned long long)power.stateMs[STRIP_POWER_OFF], power.switchOns, host_strip_stats.unpowered);
+    rx_ring_stats_t rxStats;
+    inputs_get_stats(&rxStats);
+    printf("  rx ring: %10u high water %10u overruns     %6u bytes dropped\n", rxStats.highWater,
+           rxStats.overruns, rxStats.bytesDropped);
+#ifdef CONFIG_ZBOARD_BLE_LINK
+    // What the 'i' command would report, as negotiated with the mock central
+    for (int client = 0; client < numClients; client++)
+    {
+        ble_link_info_t link;
+        if (ble_link_get_info(client, &link) == 0)
+        {
+            printf("  link %d:  PHY %u/%u  data length %u/%u  MTU %u  interval %6.2f ms  latency %u  %s  %u relaxed\n",
+                   client, link.txPhy, link.rxPhy, link.txMaxLen, link.rxMaxLen, link.mtu, link.interval * 1.25,
+                   link.latency, link.bIdle ? "idle" : "fast", link.relaxes);
+        }
+    }
+#endif
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+    // What the 's' command would report, from the firmware's own histograms. Unlike the figures above,
+    // send includes the time spent in the mock strip.
+    for (int i = 0; i < NUM_LATENCY_STAGES; i++)
+    {
+        latency_summary_t summary;
+        latency_stats_summary(i, &summary);
+        printf("  %-8s min %6u us  p50 %6u us  p99 %6u us  max %6u us\n", latency_stage_names[i], summary.minUs,
+               summary.p50Us, summary.p99Us, summary.maxUs);
+    }
+#endif
+#ifdef CONFIG_ZBOARD_PROBLEM_CACHE
+    printf("  cache:   %10u hits       %10u misses\n", problem_cache_stats.hits, problem_cache_stats.misses);
+#endif
+    printf("  output checksum: %08x\n", res.checksum);
+
+    if (checkExpected && res.checksum != expected)
+    {
+        printf("FAIL: expected output checksum %08x\n", expected);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef _HOST_H
+#define _HOST_H
+
+// Interface between the host harness and the mocked Zephyr environment in host_stubs.c / mock_led_strip.c
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/led_strip.h>
+#include <zephyr/kernel.h>
+
+typedef struct hostStripStats
+{
+    uint32_t updates;      // calls to led_strip_update_rgb()
+    uint64_t pixelsSent;   // pixels pushed across all updates
+    uint64_t bytesSent;    // bytes on the wire (3 per pixel for WS2812)
+    uint64_t mockNs;       // time spent inside the mocks (e.g. decoding I2S data), which the bench excludes
+    uint32_t powerOns;     // times the strip's power rail was switched on (see mock_gpio.c)
+    uint32_t unpowered;    // updates sent while the rail was off, which the LEDs ignore
+} host_strip_stats_t;
+
+// What the LEDs are currently showing, i.e. the result of every update so far
+extern struct led_rgb host_strip_state[HOST_STRIP_LENGTH];
+extern host_strip_stats_t host_strip_stats;
+extern bool host_strip_powered;
+
+void host_strip_reset(void);
+void host_strip_latch(size_t first, const struct led_rgb *pixels, size_t num_pixels);
+uint32_t host_strip_checksum(void);
+
+// Pops the next work item from the highest priority queue that has one, or NULL if none are pending.
+// The caller runs the handler.
+struct k_work *host_work_next(void);
+
+// Queue bytes in the mock UART RX FIFO and raise the RX interrupt
+void host_uart_inject(const uint8_t *data, size_t len);
+
+// Copies out and clears what the application has sent on the UART. Returns the number of bytes copied.
+size_t host_uart_take_tx(uint8_t *buf, size_t len);
+
+// Mock BLE clients, one per connection slot (CONFIG_BT_MAX_CONN). host_nus_inject() connects the
+// client first if need be, then delivers the data as writes of at most one ATT payload each, which is
+// 20 bytes until the MTU has been exchanged.
+void host_nus_connect(int client);
+void host_nus_disconnect(int client);
+void host_nus_inject(int client, const uint8_t *data, size_t len);
+
+uint64_t host_time_ns(void);
+
+#endif // _HOST_H
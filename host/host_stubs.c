@@ -0,0 +1,576 @@
+#include "host.h"
+
+#include <time.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/services/nus.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
+int host_log_level = LOG_LEVEL_NONE;
+
+const struct device DT_N_ALIAS_led_strip = {.name = "mock_led_strip"};
+const struct device DT_N_ALIAS_led_strip_1 = {.name = "mock_led_strip_1"};
+const struct device DT_N_ALIAS_led_strip_2 = {.name = "mock_led_strip_2"};
+const struct device DT_N_ALIAS_led_strip_3 = {.name = "mock_led_strip_3"};
+const struct device DT_N_ALIAS_zboard_input = {.name = "mock_uart"};
+const struct device DT_N_BUS = {.name = "mock_i2s"};
+
+bool device_is_ready(const struct device *dev)
+{
+    return dev != NULL;
+}
+
+uint64_t host_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Kernel
+
+struct k_work_q k_sys_work_q = {.name = "sysworkq", .priority = CONFIG_SYSTEM_WORKQUEUE_PRIORITY};
+static struct k_work_q *workQueues = &k_sys_work_q;
+static int64_t sleptMs = 0; // k_sleep() returns immediately, but still moves the uptime clock forward
+
+void k_work_init(struct k_work *work, k_work_handler_t handler)
+{
+    work->handler = handler;
+    work->next = NULL;
+    work->pending = false;
+}
+
+void k_work_queue_init(struct k_work_q *queue)
+{
+    memset(queue, 0, sizeof(*queue));
+}
+
+void k_work_queue_start(struct k_work_q *queue, k_thread_stack_t *stack, size_t stack_size, int prio,
+                        const struct k_work_queue_config *cfg)
+{
+    queue->name = cfg ? cfg->name : NULL;
+    queue->priority = prio;
+    queue->next = workQueues;
+    workQueues = queue;
+}
+
+int k_work_submit_to_queue(struct k_work_q *queue, struct k_work *work)
+{
+    if (work->pending)
+    {
+        return 0;
+    }
+    work->pending = true;
+    work->next = NULL;
+    work->submitted_ns = host_time_ns();
+    if (queue->tail)
+    {
+        queue->tail->next = work;
+    }
+    else
+    {
+        queue->head = work;
+    }
+    queue->tail = work;
+    return 1;
+}
+
+int k_work_submit(struct k_work *work)
+{
+    return k_work_submit_to_queue(&k_sys_work_q, work);
+}
+
+struct k_work *host_work_next(void)
+{
+    struct k_work_q *queue = NULL;
+    for (struct k_work_q *q = workQueues; q; q = q->next)
+    {
+        if (q->head && (!queue || q->priority < queue->priority))
+        {
+            queue = q;
+        }
+    }
+    if (!queue)
+    {
+        return NULL;
+    }
+    struct k_work *work = queue->head;
+    queue->head = work->next;
+    if (!queue->head)
+    {
+        queue->tail = NULL;
+    }
+    work->next = NULL;
+    work->pending = false;
+    return work;
+}
+
+static struct k_timer *timers = NULL; // Every timer that has been initialised
+
+void k_timer_init(struct k_timer *timer, k_timer_expiry_t expiry_fn, k_timer_stop_t stop_fn)
+{
+    timer->expiry_fn = expiry_fn;
+    timer->stop_fn = stop_fn;
+    timer->active = false;
+    timer->next = timers;
+    timers = timer;
+}
+
+void k_timer_start(struct k_timer *timer, k_timeout_t duration, k_timeout_t period)
+{
+    timer->deadline = sleptMs + MAX(duration.ms, 0);
+    timer->period = MAX(period.ms, 0);
+    timer->active = true;
+}
+
+void k_timer_stop(struct k_timer *timer)
+{
+    if (!timer->active)
+    {
+        return;
+    }
+    timer->active = false;
+    if (timer->stop_fn)
+    {
+        timer->stop_fn(timer);
+    }
+}
+
+int32_t k_sleep(k_timeout_t timeout)
+{
+    if (timeout.ms <= 0)
+    {
+        return 0;
+    }
+    // Move the clock forward one millisecond at a time, firing timers as they fall due
+    for (int64_t end = sleptMs + timeout.ms; sleptMs < end;)
+    {
+        sleptMs++;
+        for (struct k_timer *timer = timers; timer; timer = timer->next)
+        {
+            if (!timer->active || timer->deadline > sleptMs)
+            {
+                continue;
+            }
+            if (timer->period > 0)
+            {
+                timer->deadline += timer->period;
+            }
+            else
+            {
+                timer->active = false;
+            }
+            timer->expiry_fn(timer);
+        }
+    }
+    return 0;
+}
+
+int64_t k_uptime_get(void)
+{
+    return (int64_t)(host_time_ns() / 1000000u) + sleptMs;
+}
+
+uint32_t k_cycle_get_32(void)
+{
+    return (uint32_t)host_time_ns();
+}
+
+int64_t k_uptime_ticks(void)
+{
+    return k_uptime_get() * 1000;
+}
+
+int k_mem_slab_alloc(struct k_mem_slab *slab, void **mem, k_timeout_t timeout)
+{
+    for (uint32_t i = 0; i < slab->num_blocks && i < HOST_MEM_SLAB_MAX_BLOCKS; i++)
+    {
+        if (!slab->used[i])
+        {
+            slab->used[i] = true;
+            *mem = slab->buffer + i * slab->block_size;
+            return 0;
+        }
+    }
+    *mem = NULL;
+    return -ENOMEM; // Nothing would ever free a block while we waited
+}
+
+void k_mem_slab_free(struct k_mem_slab *slab, void *mem)
+{
+    slab->used[((char *)mem - slab->buffer) / slab->block_size] = false;
+}
+
+// UART
+
+#define HOST_UART_FIFO_SIZE 1024
+
+static uint8_t uartFifo[HOST_UART_FIFO_SIZE];
+static size_t uartHead = 0;
+static size_t uartCount = 0;
+static uart_irq_callback_user_data_t uartCb = NULL;
+static bool uartRxEnabled = false;
+
+int uart_irq_callback_set(const struct device *dev, uart_irq_callback_user_data_t cb)
+{
+    uartCb = cb;
+    return 0;
+}
+
+void uart_irq_rx_enable(const struct device *dev)
+{
+    uartRxEnabled = true;
+}
+
+int uart_irq_update(const struct device *dev)
+{
+    return 1;
+}
+
+int uart_irq_rx_ready(const struct device *dev)
+{
+    return uartRxEnabled && uartCount > 0;
+}
+
+int uart_fifo_read(const struct device *dev, uint8_t *rx_data, const int size)
+{
+    int n = 0;
+    while (n < size && uartCount > 0)
+    {
+        rx_data[n++] = uartFifo[uartHead];
+        uartHead = (uartHead + 1) % HOST_UART_FIFO_SIZE;
+        uartCount--;
+    }
+    return n;
+}
+
+#define HOST_UART_TX_SIZE 8192 // Enough for the longest reply, the trace dump
+
+static uint8_t uartTx[HOST_UART_TX_SIZE];
+static size_t uartTxCount = 0;
+
+void uart_poll_out(const struct device *dev, unsigned char out_char)
+{
+    if (uartTxCount < HOST_UART_TX_SIZE)
+    {
+        uartTx[uartTxCount++] = out_char;
+    }
+}
+
+size_t host_uart_take_tx(uint8_t *buf, size_t len)
+{
+    size_t n = uartTxCount < len ? uartTxCount : len;
+    memcpy(buf, uartTx, n);
+    memmove(uartTx, &uartTx[n], uartTxCount - n);
+    uartTxCount -= n;
+    return n;
+}
+
+void host_uart_inject(const uint8_t *data, size_t len)
+{
+    // The interrupt fires whenever there is data, so the FIFO only overflows if the callback doesn't read it
+    size_t i = 0;
+    do
+    {
+        for (; i < len && uartCount < HOST_UART_FIFO_SIZE; i++)
+        {
+            uartFifo[(uartHead + uartCount) % HOST_UART_FIFO_SIZE] = data[i];
+            uartCount++;
+        }
+        size_t before = uartCount;
+        if (uartCb)
+        {
+            uartCb(&DT_N_ALIAS_zboard_input, NULL);
+        }
+        if (uartCount == before)
+        {
+            break;
+        }
+    } while (i < len);
+}
+
+// Bluetooth
+
+const struct bt_le_adv_param host_bt_adv_param = {0};
+
+int bt_enable(bt_ready_cb_t cb)
+{
+    if (cb)
+    {
+        cb(0);
+    }
+    return 0;
+}
+
+// The mock central: what a phone connects with, and the most it grants when asked for more
+#define HOST_CENTRAL_INTERVAL 24 // 30 ms
+#define HOST_CENTRAL_TIMEOUT 400 // 4 s
+#define HOST_CENTRAL_MTU 247     // what most phones offer
+#define HOST_DEFAULT_MTU 23      // until the MTU has been exchanged
+
+#define HOST_MAX_CONN_CBS 4
+
+static struct bt_conn conns[CONFIG_BT_MAX_CONN];
+static bool connected[CONFIG_BT_MAX_CONN];
+static struct bt_conn_cb *connCbs[HOST_MAX_CONN_CBS];
+static int numConnCbs = 0;
+static struct bt_gatt_cb *gattCb = NULL;
+static struct bt_nus_cb *nusCb = NULL;
+static void *nusCtx = NULL;
+
+// Calls a connection callback, if set, of every registered bt_conn_cb
+#define FOR_EACH_CONN_CB(_fn, ...)          \
+    for (int _i = 0; _i < numConnCbs; _i++) \
+    {                                       \
+        if (connCbs[_i]->_fn)               \
+        {                                   \
+            connCbs[_i]->_fn(__VA_ARGS__);  \
+        }                                   \
+    }
+
+int bt_conn_cb_register(struct bt_conn_cb *cb)
+{
+    if (numConnCbs == HOST_MAX_CONN_CBS)
+    {
+        return -ENOMEM;
+    }
+    connCbs[numConnCbs++] = cb;
+    return 0;
+}
+
+int bt_conn_get_info(const struct bt_conn *conn, struct bt_conn_info *info)
+{
+    info->le.interval = conn->interval;
+    info->le.latency = conn->latency;
+    info->le.timeout = conn->timeout;
+    return 0;
+}
+
+// The central picks the shortest interval it is offered
+int bt_conn_le_param_update(struct bt_conn *conn, const struct bt_le_conn_param *param)
+{
+    conn->interval = param->interval_min;
+    conn->latency = param->latency;
+    conn->timeout = param->timeout;
+    FOR_EACH_CONN_CB(le_param_updated, conn, conn->interval, conn->latency, conn->timeout);
+    return 0;
+}
+
+int bt_conn_le_phy_update(struct bt_conn *conn, const struct bt_conn_le_phy_param *param)
+{
+    struct bt_conn_le_phy_info info = {.tx_phy = param->pref_tx_phy, .rx_phy = param->pref_rx_phy};
+    FOR_EACH_CONN_CB(le_phy_updated, conn, &info);
+    return 0;
+}
+
+int bt_conn_le_data_len_update(struct bt_conn *conn, const struct bt_conn_le_data_len_param *param)
+{
+    struct bt_conn_le_data_len_info info = {.tx_max_len = param->tx_max_len,
+                                            .tx_max_time = param->tx_max_time,
+                                            .rx_max_len = BT_GAP_DATA_LEN_MAX,
+                                            .rx_max_time = BT_GAP_DATA_TIME_MAX};
+    FOR_EACH_CONN_CB(le_data_len_updated, conn, &info);
+    return 0;
+}
+
+void bt_gatt_cb_register(struct bt_gatt_cb *cb)
+{
+    gattCb = cb;
+}
+
+int bt_gatt_exchange_mtu(struct bt_conn *conn, struct bt_gatt_exchange_params *params)
+{
+    conn->mtu = MIN(HOST_CENTRAL_MTU, CONFIG_BT_L2CAP_TX_MTU);
+    if (gattCb && gattCb->att_mtu_updated)
+    {
+        gattCb->att_mtu_updated(conn, conn->mtu, conn->mtu);
+    }
+    params->func(conn, 0, params);
+    return 0;
+}
+
+uint16_t bt_gatt_get_mtu(struct bt_conn *conn)
+{
+    return conn->mtu;
+}
+
+uint8_t bt_conn_index(const struct bt_conn *conn)
+{
+    return conn->index;
+}
+
+struct bt_conn *bt_conn_ref(struct bt_conn *conn)
+{
+    conn->refs++;
+    return conn;
+}
+
+void bt_conn_unref(struct bt_conn *conn)
+{
+    conn->refs--;
+}
+
+int bt_nus_cb_register(struct bt_nus_cb *cb, void *ctx)
+{
+    nusCb = cb;
+    nusCtx = ctx;
+    return 0;
+}
+
+int bt_nus_send(struct bt_conn *conn, const void *data, uint16_t len)
+{
+    if (len > conn->mtu - 3)
+    {
+        return -EMSGSIZE; // As the real stack does for a notification longer than the ATT payload
+    }
+    const uint8_t *bytes = data;
+    for (uint16_t i = 0; i < len; i++)
+    {
+        uart_poll_out(&DT_N_ALIAS_zboard_input, bytes[i]);
+    }
+    return 0;
+}
+
+void host_nus_connect(int client)
+{
+    if (connected[client])
+    {
+        return;
+    }
+    conns[client] = (struct bt_conn){.index = client,
+                                     .mtu = HOST_DEFAULT_MTU,
+                                     .interval = HOST_CENTRAL_INTERVAL,
+                                     .timeout = HOST_CENTRAL_TIMEOUT};
+    connected[client] = true;
+    FOR_EACH_CONN_CB(connected, &conns[client], 0);
+}
+
+void host_nus_disconnect(int client)
+{
+    if (!connected[client])
+    {
+        return;
+    }
+    connected[client] = false;
+    FOR_EACH_CONN_CB(disconnected, &conns[client], 0x13); // Remote user terminated connection
+}
+
+void host_nus_inject(int client, const uint8_t *data, size_t len)
+{
+    host_nus_connect(client);
+    size_t maxWrite = conns[client].mtu - 3; // ATT payload
+    for (size_t i = 0; i < len && nusCb && nusCb->received; i += maxWrite)
+    {
+        nusCb->received(&conns[client], &data[i], MIN(len - i, maxWrite), nusCtx);
+    }
+}
+
+int bt_le_adv_start(const struct bt_le_adv_param *param, const struct bt_data *ad, size_t ad_len,
+                    const struct bt_data *sd, size_t sd_len)
+{
+    return 0;
+}
+
+const char *bt_hci_err_to_str(uint8_t hci_err)
+{
+    return "";
+}
+
+// Settings, kept in memory for the lifetime of the process
+
+#define HOST_SETTINGS_MAX 16
+#define HOST_SETTINGS_NAME_MAX 32
+#define HOST_SETTINGS_VALUE_MAX 256
+
+typedef struct hostSetting
+{
+    char name[HOST_SETTINGS_NAME_MAX];
+    uint8_t value[HOST_SETTINGS_VALUE_MAX];
+    size_t len;
+} host_setting_t;
+
+static host_setting_t settings[HOST_SETTINGS_MAX];
+static size_t numSettings = 0;
+static struct settings_handler_static *settingsHandlers = NULL;
+
+void host_settings_register(struct settings_handler_static *handler)
+{
+    handler->next = settingsHandlers;
+    settingsHandlers = handler;
+}
+
+int settings_subsys_init(void)
+{
+    return 0;
+}
+
+static host_setting_t *findSetting(const char *name)
+{
+    for (size_t i = 0; i < numSettings; i++)
+    {
+        if (strcmp(settings[i].name, name) == 0)
+        {
+            return &settings[i];
+        }
+    }
+    return NULL;
+}
+
+int settings_save_one(const char *name, const void *value, size_t val_len)
+{
+    if (strlen(name) >= HOST_SETTINGS_NAME_MAX || val_len > HOST_SETTINGS_VALUE_MAX)
+    {
+        return -EINVAL;
+    }
+    host_setting_t *setting = findSetting(name);
+    if (!setting)
+    {
+        if (numSettings == HOST_SETTINGS_MAX)
+        {
+            return -ENOMEM;
+        }
+        setting = &settings[numSettings++];
+    }
+    strcpy(setting->name, name);
+    memcpy(setting->value, value, val_len);
+    setting->len = val_len;
+    return 0;
+}
+
+int settings_delete(const char *name)
+{
+    host_setting_t *setting = findSetting(name);
+    if (setting)
+    {
+        *setting = settings[--numSettings];
+    }
+    return 0;
+}
+
+static ssize_t readSetting(void *cb_arg, void *data, size_t len)
+{
+    host_setting_t *setting = cb_arg;
+    size_t n = len < setting->len ? len : setting->len;
+    memcpy(data, setting->value, n);
+    return n;
+}
+
+int settings_load(void)
+{
+    for (size_t i = 0; i < numSettings; i++)
+    {
+        for (struct settings_handler_static *h = settingsHandlers; h; h = h->next)
+        {
+            size_t n = strlen(h->name);
+            if (h->h_set && strncmp(settings[i].name, h->name, n) == 0 && settings[i].name[n] == '/')
+            {
+                h->h_set(&settings[i].name[n + 1], settings[i].len, readSetting, &settings[i]);
+            }
+        }
+    }
+    return 0;
+}
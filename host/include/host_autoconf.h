@@ -0,0 +1,52 @@
+#ifndef _HOST_AUTOCONF_H
+#define _HOST_AUTOCONF_H
+
+// Kconfig values for the host build, mirroring prj.conf. Passed to every source with -imacros,
+// the same way Zephyr injects its generated autoconf.h.
+
+#define CONFIG_BT 1
+#define CONFIG_BT_MAX_CONN 4
+#define CONFIG_BT_DEVICE_NAME "zboard"
+#define CONFIG_BT_L2CAP_TX_MTU 512
+#define CONFIG_LED_STRIP 1
+#define CONFIG_LOG 1
+#define CONFIG_SETTINGS 1
+#define CONFIG_SYSTEM_WORKQUEUE_PRIORITY -1
+#define CONFIG_GPIO 1
+#define CONFIG_ZBOARD_WIRING_RUNTIME 1
+#ifdef HOST_LAYOUT_RUNTIME // Defined for zboard_bench_layouts, which can switch layouts at runtime
+#define CONFIG_ZBOARD_LAYOUT_RUNTIME 1
+#endif
+#define CONFIG_ZBOARD_STRIP_PARTIAL_UPDATE 1
+#define CONFIG_ZBOARD_STRIP_I2S_DIRECT 1
+#define CONFIG_ZBOARD_FRAMEBUFFER_PALETTE 1
+#define CONFIG_ZBOARD_BLE_LINK 1
+#define CONFIG_ZBOARD_BLE_FAST_INTERVAL_MIN 12
+#define CONFIG_ZBOARD_BLE_FAST_INTERVAL_MAX 24
+#define CONFIG_ZBOARD_BLE_IDLE_INTERVAL_MIN 80
+#define CONFIG_ZBOARD_BLE_IDLE_INTERVAL_MAX 96
+#define CONFIG_ZBOARD_BLE_IDLE_LATENCY 0
+#define CONFIG_ZBOARD_BLE_IDLE_DELAY_MS 10000
+#define CONFIG_ZBOARD_STRIP_POWER 1
+#define CONFIG_ZBOARD_STRIP_POWER_OFF_DELAY_MS 2000
+#define CONFIG_ZBOARD_STRIP_POWER_SETTLE_US 1000
+#ifndef HOST_SYSTEM_WORKQUEUE_ONLY // Defined for zboard_bench_sysq, which renders on the system workqueue
+#define CONFIG_ZBOARD_RENDER_WORKQUEUE 1
+#define CONFIG_ZBOARD_RENDER_WORKQUEUE_PRIORITY -2
+#define CONFIG_ZBOARD_RENDER_WORKQUEUE_STACK_SIZE 1536
+#endif
+#define CONFIG_ZBOARD_PATTERN_FPS 20
+#define CONFIG_ZBOARD_PATTERN_FRAME_SKIP 1
+#define CONFIG_ZBOARD_PROBLEM_CACHE 1
+#define CONFIG_ZBOARD_PROBLEM_CACHE_ENTRIES 4
+#define CONFIG_ZBOARD_PROBLEM_QUEUE_DEPTH 1
+#define CONFIG_ZBOARD_PROBLEM_LIBRARY 1
+#define CONFIG_ZBOARD_PLAYLIST 1
+#define CONFIG_ZBOARD_PLAYLIST_ENTRIES 16
+#define CONFIG_ZBOARD_RENDER_ACKS 1
+#define CONFIG_ZBOARD_RX_RING_SIZE 1024
+#define CONFIG_ZBOARD_LATENCY_STATS 1
+#define CONFIG_ZBOARD_TRACE 1
+#define CONFIG_ZBOARD_TRACE_ENTRIES 128
+
+#endif // _HOST_AUTOCONF_H
@@ -0,0 +1,96 @@
+#ifndef _HOST_ZEPHYR_BLUETOOTH_CONN_H
+#define _HOST_ZEPHYR_BLUETOOTH_CONN_H
+
+// Host stand-in for connection objects. The harness connects mock clients with host_nus_connect(), and
+// the mock central grants every link parameter request at once (see host_stubs.c).
+
+#include <stdint.h>
+
+#include <zephyr/bluetooth/gap.h>
+
+struct bt_conn
+{
+    uint8_t index;
+    int refs;
+    uint16_t mtu;
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+struct bt_le_conn_param
+{
+    uint16_t interval_min;
+    uint16_t interval_max;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+#define BT_LE_CONN_PARAM_INIT(int_min, int_max, lat, to) \
+    {.interval_min = (int_min), .interval_max = (int_max), .latency = (lat), .timeout = (to)}
+
+struct bt_conn_le_phy_param
+{
+    uint16_t options;
+    uint8_t pref_tx_phy;
+    uint8_t pref_rx_phy;
+};
+
+#define BT_CONN_LE_PHY_PARAM_2M \
+    (&(struct bt_conn_le_phy_param){.pref_tx_phy = BT_GAP_LE_PHY_2M, .pref_rx_phy = BT_GAP_LE_PHY_2M})
+
+struct bt_conn_le_phy_info
+{
+    uint8_t tx_phy;
+    uint8_t rx_phy;
+};
+
+struct bt_conn_le_data_len_param
+{
+    uint16_t tx_max_len;
+    uint16_t tx_max_time;
+};
+
+#define BT_LE_DATA_LEN_PARAM_MAX \
+    (&(struct bt_conn_le_data_len_param){.tx_max_len = BT_GAP_DATA_LEN_MAX, .tx_max_time = BT_GAP_DATA_TIME_MAX})
+
+struct bt_conn_le_data_len_info
+{
+    uint16_t tx_max_len;
+    uint16_t tx_max_time;
+    uint16_t rx_max_len;
+    uint16_t rx_max_time;
+};
+
+struct bt_conn_le_info
+{
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+struct bt_conn_info
+{
+    struct bt_conn_le_info le;
+};
+
+struct bt_conn_cb
+{
+    void (*connected)(struct bt_conn *conn, uint8_t err);
+    void (*disconnected)(struct bt_conn *conn, uint8_t reason);
+    void (*recycled)(void);
+    void (*le_param_updated)(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout);
+    void (*le_phy_updated)(struct bt_conn *conn, struct bt_conn_le_phy_info *param);
+    void (*le_data_len_updated)(struct bt_conn *conn, struct bt_conn_le_data_len_info *info);
+};
+
+int bt_conn_cb_register(struct bt_conn_cb *cb);
+uint8_t bt_conn_index(const struct bt_conn *conn);
+struct bt_conn *bt_conn_ref(struct bt_conn *conn);
+void bt_conn_unref(struct bt_conn *conn);
+int bt_conn_get_info(const struct bt_conn *conn, struct bt_conn_info *info);
+int bt_conn_le_param_update(struct bt_conn *conn, const struct bt_le_conn_param *param);
+int bt_conn_le_phy_update(struct bt_conn *conn, const struct bt_conn_le_phy_param *param);
+int bt_conn_le_data_len_update(struct bt_conn *conn, const struct bt_conn_le_data_len_param *param);
+
+#endif // _HOST_ZEPHYR_BLUETOOTH_CONN_H
@@ -0,0 +1,12 @@
+#ifndef _HOST_ZEPHYR_BLUETOOTH_GAP_H
+#define _HOST_ZEPHYR_BLUETOOTH_GAP_H
+
+#define BT_GAP_LE_PHY_1M 0x01
+#define BT_GAP_LE_PHY_2M 0x02
+#define BT_GAP_LE_PHY_CODED 0x04
+
+#define BT_GAP_DATA_LEN_DEFAULT 0x001b // 27 bytes
+#define BT_GAP_DATA_LEN_MAX 0x00fb     // 251 bytes
+#define BT_GAP_DATA_TIME_MAX 0x4290    // 17040 us
+
+#endif // _HOST_ZEPHYR_BLUETOOTH_GAP_H
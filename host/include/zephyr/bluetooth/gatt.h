@@ -0,0 +1,24 @@
+#ifndef _HOST_ZEPHYR_BLUETOOTH_GATT_H
+#define _HOST_ZEPHYR_BLUETOOTH_GATT_H
+
+// Host stand-in for the GATT MTU exchange. The mock central answers with HOST_CENTRAL_MTU.
+
+#include <stdint.h>
+
+#include <zephyr/bluetooth/conn.h>
+
+struct bt_gatt_exchange_params
+{
+    void (*func)(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params);
+};
+
+struct bt_gatt_cb
+{
+    void (*att_mtu_updated)(struct bt_conn *conn, uint16_t tx, uint16_t rx);
+};
+
+void bt_gatt_cb_register(struct bt_gatt_cb *cb);
+int bt_gatt_exchange_mtu(struct bt_conn *conn, struct bt_gatt_exchange_params *params);
+uint16_t bt_gatt_get_mtu(struct bt_conn *conn);
+
+#endif // _HOST_ZEPHYR_BLUETOOTH_GATT_H
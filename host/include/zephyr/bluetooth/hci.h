@@ -0,0 +1,8 @@
+#ifndef _HOST_ZEPHYR_BLUETOOTH_HCI_H
+#define _HOST_ZEPHYR_BLUETOOTH_HCI_H
+
+#include <stdint.h>
+
+const char *bt_hci_err_to_str(uint8_t hci_err);
+
+#endif // _HOST_ZEPHYR_BLUETOOTH_HCI_H
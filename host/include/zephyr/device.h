@@ -0,0 +1,83 @@
+#ifndef _HOST_ZEPHYR_DEVICE_H
+#define _HOST_ZEPHYR_DEVICE_H
+
+// Minimal host stand-in for <zephyr/device.h> and the devicetree macros the zboard sources use.
+// Every DT_ALIAS(x) resolves to a device object named DT_N_ALIAS_x that is defined in host_stubs.c,
+// and DT_PROP(node, prop) to a <node>_P_<prop> define below, as Zephyr's generated devicetree does.
+
+#include <stdbool.h>
+
+#include <zephyr/sys/util.h>
+
+struct device
+{
+    const char *name;
+};
+
+#define DT_CAT3(a, b, c) a##b##c
+#define DT_ALIAS(alias) DT_N_ALIAS_##alias
+#define DT_HAS_ALIAS(alias) IS_ENABLED(DT_N_ALIAS_##alias##_EXISTS)
+#define DT_CHOSEN(prop) DT_N_CHOSEN_##prop
+#define DT_PATH(name) DT_N_S_##name
+#define DT_BUS(node) DT_N_BUS // The only node with a bus is the led_strip on the I2S controller
+#define DT_NODE_HAS_PROP(node, prop) IS_ENABLED(DT_CAT3(node, _P_, prop##_EXISTS))
+#define DT_PROP(node, prop) DT_CAT3(node, _P_, prop)
+#define DT_PROP_LEN(node, prop) DT_CAT3(node, _P_, prop##_LEN)
+#define DEVICE_DT_GET(node) (&(node))
+
+// The strip is HOST_STRIP_LENGTH LEDs split evenly into HOST_STRIP_SEGMENTS segments: the worldsemi,ws2812-i2s
+// node in nrf52832_mdk.overlay (led-strip), followed by led_strip devices on the aliases led-strip-1 to -3
+#ifndef HOST_STRIP_LENGTH
+#define HOST_STRIP_LENGTH 256
+#endif
+#ifndef HOST_STRIP_SEGMENTS
+#define HOST_STRIP_SEGMENTS 1
+#endif
+#define HOST_SEGMENT_LENGTH (HOST_STRIP_LENGTH / HOST_STRIP_SEGMENTS)
+
+// Properties of the led-strip node (and binding defaults)
+#define DT_N_ALIAS_led_strip_P_chain_length_EXISTS 1
+#define DT_N_ALIAS_led_strip_P_chain_length HOST_SEGMENT_LENGTH
+#define DT_N_ALIAS_led_strip_P_color_mapping {2, 1, 3} // LED_COLOR_ID_GREEN, LED_COLOR_ID_RED, LED_COLOR_ID_BLUE
+#define DT_N_ALIAS_led_strip_P_color_mapping_LEN 3
+#define DT_N_ALIAS_led_strip_P_reset_delay 120
+#define DT_N_ALIAS_led_strip_P_lrck_period 10
+#define DT_N_ALIAS_led_strip_P_extra_wait_time 300
+#define DT_N_ALIAS_led_strip_P_out_active_low 0
+#define DT_N_ALIAS_led_strip_P_nibble_one 0x0E
+#define DT_N_ALIAS_led_strip_P_nibble_zero 0x08
+
+#if HOST_STRIP_SEGMENTS > 1
+#define DT_N_ALIAS_led_strip_1_EXISTS 1
+#define DT_N_ALIAS_led_strip_1_P_chain_length HOST_SEGMENT_LENGTH
+#endif
+#if HOST_STRIP_SEGMENTS > 2
+#define DT_N_ALIAS_led_strip_2_EXISTS 1
+#define DT_N_ALIAS_led_strip_2_P_chain_length HOST_SEGMENT_LENGTH
+#endif
+#if HOST_STRIP_SEGMENTS > 3
+#define DT_N_ALIAS_led_strip_3_EXISTS 1
+#define DT_N_ALIAS_led_strip_3_P_chain_length HOST_SEGMENT_LENGTH
+#endif
+
+// The strip's power rail (strip-power-gpios of the zephyr,user node), see mock_gpio.c
+#define DT_N_S_zephyr_user_P_strip_power_gpios_EXISTS 1
+#define DT_N_S_zephyr_user_P_strip_power_gpios {.port = &DT_N_S_soc_S_gpio, .pin = 20, .dt_flags = 0}
+
+// Properties of the nRF52832 flash (zephyr,flash)
+#define HOST_FLASH_WRITE_BLOCK_SIZE 4
+#define HOST_FLASH_ERASE_BLOCK_SIZE 4096
+#define DT_N_CHOSEN_zephyr_flash_P_write_block_size HOST_FLASH_WRITE_BLOCK_SIZE
+#define DT_N_CHOSEN_zephyr_flash_P_erase_block_size HOST_FLASH_ERASE_BLOCK_SIZE
+
+extern const struct device DT_N_ALIAS_led_strip;
+extern const struct device DT_N_ALIAS_led_strip_1;
+extern const struct device DT_N_ALIAS_led_strip_2;
+extern const struct device DT_N_ALIAS_led_strip_3;
+extern const struct device DT_N_ALIAS_zboard_input;
+extern const struct device DT_N_BUS;
+extern const struct device DT_N_S_soc_S_gpio;
+
+bool device_is_ready(const struct device *dev);
+
+#endif // _HOST_ZEPHYR_DEVICE_H
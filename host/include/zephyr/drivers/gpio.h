@@ -0,0 +1,32 @@
+#ifndef _HOST_ZEPHYR_DRIVERS_GPIO_H
+#define _HOST_ZEPHYR_DRIVERS_GPIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/device.h>
+
+typedef uint32_t gpio_flags_t;
+
+#define GPIO_OUTPUT_INACTIVE 0x1
+#define GPIO_OUTPUT_ACTIVE 0x2
+
+struct gpio_dt_spec
+{
+    const struct device *port;
+    uint8_t pin;
+    uint16_t dt_flags;
+};
+
+#define GPIO_DT_SPEC_GET(node, prop) DT_PROP(node, prop)
+
+static inline bool gpio_is_ready_dt(const struct gpio_dt_spec *spec)
+{
+    return device_is_ready(spec->port);
+}
+
+// Implemented by the mock GPIO port in mock_gpio.c
+int gpio_pin_configure_dt(const struct gpio_dt_spec *spec, gpio_flags_t extra_flags);
+int gpio_pin_set_dt(const struct gpio_dt_spec *spec, int value);
+
+#endif // _HOST_ZEPHYR_DRIVERS_GPIO_H
@@ -0,0 +1,19 @@
+#ifndef _HOST_ZEPHYR_DRIVERS_LED_STRIP_H
+#define _HOST_ZEPHYR_DRIVERS_LED_STRIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/device.h>
+
+struct led_rgb
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+};
+
+// Implemented by the mock strip in mock_led_strip.c
+int led_strip_update_rgb(const struct device *dev, struct led_rgb *pixels, size_t num_pixels);
+
+#endif // _HOST_ZEPHYR_DRIVERS_LED_STRIP_H
@@ -0,0 +1,21 @@
+#ifndef _HOST_ZEPHYR_DRIVERS_UART_H
+#define _HOST_ZEPHYR_DRIVERS_UART_H
+
+// Host stand-in for the interrupt-driven UART API. The mock UART in host_stubs.c holds bytes
+// injected by the harness with host_uart_inject() until the application reads them, and collects
+// what the application sends back (see host_uart_take_tx()).
+
+#include <stdint.h>
+
+#include <zephyr/device.h>
+
+typedef void (*uart_irq_callback_user_data_t)(const struct device *dev, void *user_data);
+
+int uart_irq_callback_set(const struct device *dev, uart_irq_callback_user_data_t cb);
+void uart_irq_rx_enable(const struct device *dev);
+int uart_irq_update(const struct device *dev);
+int uart_irq_rx_ready(const struct device *dev);
+int uart_fifo_read(const struct device *dev, uint8_t *rx_data, const int size);
+void uart_poll_out(const struct device *dev, unsigned char out_char);
+
+#endif // _HOST_ZEPHYR_DRIVERS_UART_H
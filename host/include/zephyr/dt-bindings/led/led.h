@@ -0,0 +1,9 @@
+#ifndef _HOST_ZEPHYR_DT_BINDINGS_LED_LED_H
+#define _HOST_ZEPHYR_DT_BINDINGS_LED_LED_H
+
+#define LED_COLOR_ID_WHITE 0
+#define LED_COLOR_ID_RED 1
+#define LED_COLOR_ID_GREEN 2
+#define LED_COLOR_ID_BLUE 3
+
+#endif // _HOST_ZEPHYR_DT_BINDINGS_LED_LED_H
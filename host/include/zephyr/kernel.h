@@ -0,0 +1,168 @@
+#ifndef _HOST_ZEPHYR_KERNEL_H
+#define _HOST_ZEPHYR_KERNEL_H
+
+// Minimal host stand-in for <zephyr/kernel.h>. Only the parts used by the zboard sources are provided.
+// Work items are queued and only run when the host harness drains them (see host_work_next() in host.h),
+// which mirrors the firmware where handlers run later on a workqueue thread. The harness always takes
+// the next item from the highest priority queue that has one, as the scheduler would between items.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zephyr/sys/util.h>
+
+typedef struct
+{
+    int64_t ms;
+} k_timeout_t;
+
+#define K_MSEC(_ms) ((k_timeout_t){.ms = (_ms)})
+#define K_USEC(_us) K_MSEC(((_us) + 999) / 1000) // The virtual clock only counts milliseconds
+#define K_NO_WAIT K_MSEC(0)
+#define K_FOREVER K_MSEC(-1)
+#define K_TIMEOUT_ABS_TICKS(t) K_NO_WAIT // Nothing on the host ever needs to wait for hardware
+
+// One tick per microsecond
+int64_t k_uptime_ticks(void);
+#define k_us_to_ticks_ceil64(us) ((int64_t)(us))
+#define k_ticks_to_us_floor64(t) ((int64_t)(t))
+#define USEC_PER_SEC 1000000LL
+
+// Memory slabs, with a fixed maximum number of blocks
+#define HOST_MEM_SLAB_MAX_BLOCKS 4
+
+struct k_mem_slab
+{
+    char *buffer;
+    size_t block_size;
+    uint32_t num_blocks;
+    bool used[HOST_MEM_SLAB_MAX_BLOCKS];
+};
+
+#define K_MEM_SLAB_DEFINE_STATIC(name, slab_block_size, slab_num_blocks, slab_align)       \
+    static char __attribute__((aligned(slab_align))) _k_mem_slab_buf_##name[(slab_num_blocks) * (slab_block_size)]; \
+    static struct k_mem_slab name = {                                                   \
+        .buffer = _k_mem_slab_buf_##name, .block_size = (slab_block_size), .num_blocks = (slab_num_blocks)}
+
+int k_mem_slab_alloc(struct k_mem_slab *slab, void **mem, k_timeout_t timeout);
+void k_mem_slab_free(struct k_mem_slab *slab, void *mem);
+
+// The harness is single threaded, so spinlocks only need to exist
+struct k_spinlock
+{
+    int locked;
+};
+
+typedef int k_spinlock_key_t;
+
+static inline k_spinlock_key_t k_spin_lock(struct k_spinlock *l)
+{
+    l->locked++;
+    return 0;
+}
+
+static inline void k_spin_unlock(struct k_spinlock *l, k_spinlock_key_t key)
+{
+    l->locked--;
+}
+
+// Mutexes likewise never have to wait, but count their holder so misuse can be caught
+struct k_mutex
+{
+    int lock_count;
+};
+
+#define K_MUTEX_DEFINE(name) struct k_mutex name = {0}
+
+static inline int k_mutex_init(struct k_mutex *mutex)
+{
+    mutex->lock_count = 0;
+    return 0;
+}
+
+static inline int k_mutex_lock(struct k_mutex *mutex, k_timeout_t timeout)
+{
+    mutex->lock_count++;
+    return 0;
+}
+
+static inline int k_mutex_unlock(struct k_mutex *mutex)
+{
+    if (mutex->lock_count == 0)
+    {
+        return -EINVAL;
+    }
+    mutex->lock_count--;
+    return 0;
+}
+
+struct k_work;
+typedef void (*k_work_handler_t)(struct k_work *work);
+
+struct k_work
+{
+    k_work_handler_t handler;
+    struct k_work *next;
+    bool pending;
+    uint64_t submitted_ns; // When the item was last queued, for the harness to measure queueing delay
+};
+
+struct k_work_q
+{
+    const char *name;
+    int priority;
+    struct k_work *head;
+    struct k_work *tail;
+    struct k_work_q *next; // Every queue that has been started
+};
+
+struct k_work_queue_config
+{
+    const char *name;
+    bool no_yield;
+};
+
+// Stacks are never used, since handlers run on the harness thread
+#define K_THREAD_STACK_DEFINE(sym, size) char sym[size]
+#define K_THREAD_STACK_SIZEOF(sym) sizeof(sym)
+typedef char k_thread_stack_t;
+
+extern struct k_work_q k_sys_work_q;
+
+void k_work_init(struct k_work *work, k_work_handler_t handler);
+int k_work_submit(struct k_work *work);
+int k_work_submit_to_queue(struct k_work_q *queue, struct k_work *work);
+void k_work_queue_init(struct k_work_q *queue);
+void k_work_queue_start(struct k_work_q *queue, k_thread_stack_t *stack, size_t stack_size, int prio,
+                        const struct k_work_queue_config *cfg);
+
+// Timers run on a virtual clock that only moves forward in k_sleep(), which calls the expiry functions
+// of the timers that fall due, as the system clock interrupt would
+struct k_timer;
+typedef void (*k_timer_expiry_t)(struct k_timer *timer);
+typedef void (*k_timer_stop_t)(struct k_timer *timer);
+
+struct k_timer
+{
+    k_timer_expiry_t expiry_fn;
+    k_timer_stop_t stop_fn;
+    int64_t deadline; // Virtual ms
+    int64_t period;
+    bool active;
+    struct k_timer *next;
+};
+
+void k_timer_init(struct k_timer *timer, k_timer_expiry_t expiry_fn, k_timer_stop_t stop_fn);
+void k_timer_start(struct k_timer *timer, k_timeout_t duration, k_timeout_t period);
+void k_timer_stop(struct k_timer *timer);
+
+int32_t k_sleep(k_timeout_t timeout);
+int64_t k_uptime_get(void);
+uint32_t k_cycle_get_32(void);
+#define k_cyc_to_us_floor32(c) ((uint32_t)((c) / 1000u)) // Cycles are host nanoseconds
+#define sys_clock_hw_cycles_per_sec() 1000000000u
+
+#endif // _HOST_ZEPHYR_KERNEL_H
@@ -0,0 +1,34 @@
+#ifndef _HOST_ZEPHYR_LOGGING_LOG_H
+#define _HOST_ZEPHYR_LOGGING_LOG_H
+
+// Host stand-in for <zephyr/logging/log.h>. Messages go to stderr when their level is at or below
+// host_log_level, which is 0 (off) by default so that logging doesn't distort benchmark timings.
+
+#include <stdio.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERR 1
+#define LOG_LEVEL_WRN 2
+#define LOG_LEVEL_INF 3
+#define LOG_LEVEL_DBG 4
+
+extern int host_log_level;
+
+#define LOG_MODULE_REGISTER(name) static const char *const __log_module_name __attribute__((unused)) = #name
+
+#define HOST_LOG(level, ...)                      \
+    do                                            \
+    {                                             \
+        if (host_log_level >= (level))            \
+        {                                         \
+            fprintf(stderr, __VA_ARGS__);         \
+            fputc('\n', stderr);                  \
+        }                                         \
+    } while (0)
+
+#define LOG_ERR(...) HOST_LOG(LOG_LEVEL_ERR, __VA_ARGS__)
+#define LOG_WRN(...) HOST_LOG(LOG_LEVEL_WRN, __VA_ARGS__)
+#define LOG_INF(...) HOST_LOG(LOG_LEVEL_INF, __VA_ARGS__)
+#define LOG_DBG(...) HOST_LOG(LOG_LEVEL_DBG, __VA_ARGS__)
+
+#endif // _HOST_ZEPHYR_LOGGING_LOG_H
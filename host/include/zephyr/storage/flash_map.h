@@ -0,0 +1,30 @@
+#ifndef _HOST_ZEPHYR_STORAGE_FLASH_MAP_H
+#define _HOST_ZEPHYR_STORAGE_FLASH_MAP_H
+
+// Host stand-in for the flash map API. mock_flash.c provides a single RAM-backed partition that
+// behaves like NOR flash: erased bytes read as 0xFF, and writes can only clear bits.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/types.h>
+
+#define HOST_FLASH_PARTITION_SIZE 0x3C000 // library_partition in nrf52832_mdk.overlay
+
+#define FIXED_PARTITION_EXISTS(label) 1
+#define FIXED_PARTITION_ID(label) 0
+
+struct flash_area
+{
+    uint8_t fa_id;
+    uint32_t fa_off;
+    size_t fa_size;
+};
+
+int flash_area_open(uint8_t id, const struct flash_area **fa);
+void flash_area_close(const struct flash_area *fa);
+int flash_area_read(const struct flash_area *fa, off_t off, void *dst, size_t len);
+int flash_area_write(const struct flash_area *fa, off_t off, const void *src, size_t len);
+int flash_area_erase(const struct flash_area *fa, off_t off, size_t len);
+
+#endif // _HOST_ZEPHYR_STORAGE_FLASH_MAP_H
@@ -0,0 +1,31 @@
+#ifndef _HOST_ZEPHYR_SYS_ATOMIC_H
+#define _HOST_ZEPHYR_SYS_ATOMIC_H
+
+// Host stand-in for <zephyr/sys/atomic.h>, on the compiler's sequentially consistent builtins like Zephyr's
+
+typedef long atomic_t;
+typedef atomic_t atomic_val_t;
+
+#define ATOMIC_INIT(i) (i)
+
+static inline atomic_val_t atomic_get(const atomic_t *target)
+{
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_set(atomic_t *target, atomic_val_t value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_clear(atomic_t *target)
+{
+    return atomic_set(target, 0);
+}
+
+static inline atomic_val_t atomic_inc(atomic_t *target)
+{
+    return __atomic_fetch_add(target, 1, __ATOMIC_SEQ_CST);
+}
+
+#endif // _HOST_ZEPHYR_SYS_ATOMIC_H
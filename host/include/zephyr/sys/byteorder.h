@@ -0,0 +1,28 @@
+#ifndef _HOST_ZEPHYR_SYS_BYTEORDER_H
+#define _HOST_ZEPHYR_SYS_BYTEORDER_H
+
+#include <stdint.h>
+
+static inline uint16_t sys_get_be16(const uint8_t src[2])
+{
+    return ((uint16_t)src[0] << 8) | src[1];
+}
+
+static inline uint32_t sys_get_be32(const uint8_t src[4])
+{
+    return ((uint32_t)sys_get_be16(&src[0]) << 16) | sys_get_be16(&src[2]);
+}
+
+static inline void sys_put_be16(uint16_t val, uint8_t dst[2])
+{
+    dst[0] = val >> 8;
+    dst[1] = val;
+}
+
+static inline void sys_put_be32(uint32_t val, uint8_t dst[4])
+{
+    sys_put_be16(val >> 16, &dst[0]);
+    sys_put_be16(val, &dst[2]);
+}
+
+#endif // _HOST_ZEPHYR_SYS_BYTEORDER_H
@@ -0,0 +1,19 @@
+#ifndef _HOST_ZEPHYR_SYS_CRC_H
+#define _HOST_ZEPHYR_SYS_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Same algorithm as Zephyr's crc16_ccitt(): polynomial 0x1021, reflected input and output
+static inline uint16_t crc16_ccitt(uint16_t seed, const uint8_t *src, size_t len)
+{
+    for (; len > 0; len--)
+    {
+        uint8_t e = seed ^ *src++;
+        uint8_t f = e ^ (e << 4);
+        seed = (seed >> 8) ^ ((uint16_t)f << 8) ^ ((uint16_t)f << 3) ^ ((uint16_t)f >> 4);
+    }
+    return seed;
+}
+
+#endif // _HOST_ZEPHYR_SYS_CRC_H
@@ -0,0 +1,70 @@
+#include "host.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/storage/flash_map.h>
+
+// Mock flash partition with the alignment rules of the nRF52 NVMC
+
+static uint8_t flash[HOST_FLASH_PARTITION_SIZE];
+static bool bErased = false;
+static const struct flash_area partition = {.fa_id = 0, .fa_off = 0x3E000, .fa_size = sizeof(flash)};
+
+int flash_area_open(uint8_t id, const struct flash_area **fa)
+{
+    if (id != partition.fa_id)
+    {
+        return -ENOENT;
+    }
+    if (!bErased) // A new chip reads as erased
+    {
+        memset(flash, 0xFF, sizeof(flash));
+        bErased = true;
+    }
+    *fa = &partition;
+    return 0;
+}
+
+void flash_area_close(const struct flash_area *fa)
+{
+}
+
+static bool inRange(const struct flash_area *fa, off_t off, size_t len)
+{
+    return fa == &partition && off >= 0 && (size_t)off <= fa->fa_size && len <= fa->fa_size - off;
+}
+
+int flash_area_read(const struct flash_area *fa, off_t off, void *dst, size_t len)
+{
+    if (!inRange(fa, off, len))
+    {
+        return -EINVAL;
+    }
+    memcpy(dst, &flash[off], len);
+    return 0;
+}
+
+int flash_area_write(const struct flash_area *fa, off_t off, const void *src, size_t len)
+{
+    if (!inRange(fa, off, len) || off % HOST_FLASH_WRITE_BLOCK_SIZE || len % HOST_FLASH_WRITE_BLOCK_SIZE)
+    {
+        return -EINVAL;
+    }
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < len; i++)
+    {
+        flash[off + i] &= bytes[i];
+    }
+    return 0;
+}
+
+int flash_area_erase(const struct flash_area *fa, off_t off, size_t len)
+{
+    if (!inRange(fa, off, len) || off % HOST_FLASH_ERASE_BLOCK_SIZE || len % HOST_FLASH_ERASE_BLOCK_SIZE)
+    {
+        return -EINVAL;
+    }
+    memset(&flash[off], 0xFF, len);
+    return 0;
+}
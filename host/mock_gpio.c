@@ -0,0 +1,31 @@
+#include "host.h"
+
+#include <string.h>
+
+#include <zephyr/drivers/gpio.h>
+
+// Mock GPIO port. The only pin the app drives is the strip's power rail, and while it is off the LEDs
+// go dark and ignore their data, as a real strip does with its supply switched off.
+
+const struct device DT_N_S_soc_S_gpio = {.name = "mock_gpio"};
+
+bool host_strip_powered = true; // Strips without a switched rail are always powered
+
+int gpio_pin_configure_dt(const struct gpio_dt_spec *spec, gpio_flags_t extra_flags)
+{
+    return gpio_pin_set_dt(spec, (extra_flags & GPIO_OUTPUT_ACTIVE) ? 1 : 0);
+}
+
+int gpio_pin_set_dt(const struct gpio_dt_spec *spec, int value)
+{
+    if (!value)
+    {
+        memset(host_strip_state, 0, sizeof(host_strip_state));
+    }
+    else if (!host_strip_powered)
+    {
+        host_strip_stats.powerOns++;
+    }
+    host_strip_powered = value;
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "host.h"
+
+// Mock led_strip device. Keeps a copy of what the physical strip would be showing so the harness can
+// check that an optimisation doesn't change the output, and counts what was pushed to the strip.
+
+#define WS2812_BYTES_PER_PIXEL 3
+
+struct led_rgb host_strip_state[HOST_STRIP_LENGTH];
+host_strip_stats_t host_strip_stats;
+
+void host_strip_reset(void)
+{
+    memset(host_strip_state, 0, sizeof(host_strip_state));
+    memset(&host_strip_stats, 0, sizeof(host_strip_stats));
+}
+
+// FNV-1a over the current strip contents
+uint32_t host_strip_checksum(void)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < HOST_STRIP_LENGTH; i++)
+    {
+        const uint8_t bytes[] = {host_strip_state[i].r, host_strip_state[i].g, host_strip_state[i].b};
+        for (size_t j = 0; j < sizeof(bytes); j++)
+        {
+            hash = (hash ^ bytes[j]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// The first num_pixels LEDs of the segment starting at LED first take the new colours and the rest keep
+// theirs, as WS2812 LEDs do
+void host_strip_latch(size_t first, const struct led_rgb *pixels, size_t num_pixels)
+{
+    if (!host_strip_powered)
+    {
+        host_strip_stats.unpowered++;
+    }
+    else
+    {
+        memcpy(&host_strip_state[first], pixels, num_pixels * sizeof(struct led_rgb));
+    }
+    host_strip_stats.updates++;
+    host_strip_stats.pixelsSent += num_pixels;
+    host_strip_stats.bytesSent += num_pixels * WS2812_BYTES_PER_PIXEL;
+}
+
+int led_strip_update_rgb(const struct device *dev, struct led_rgb *pixels, size_t num_pixels)
+{
+    static const struct device *const segments[] = {
+        &DT_N_ALIAS_led_strip,
+        &DT_N_ALIAS_led_strip_1,
+        &DT_N_ALIAS_led_strip_2,
+        &DT_N_ALIAS_led_strip_3,
+    };
+    for (int i = 0; i < HOST_STRIP_SEGMENTS; i++)
+    {
+        if (dev == segments[i] && num_pixels <= HOST_SEGMENT_LENGTH)
+        {
+            host_strip_latch(i * HOST_SEGMENT_LENGTH, pixels, num_pixels);
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
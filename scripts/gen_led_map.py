@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""Generates the zboard LED map tables at build time.
+
+The output header describes each board layout n that is built in (the first is the one selected in Kconfig)
+with initializers for the const tables in led_map.c:
+  LED_MAP_LAYOUT_n_TABLE             - LED number for each hold position, indexed by col * rows + row (rows numbered bottom up)
+  LED_MAP_LAYOUT_n_HOLD_TABLE        - LED number for each hold number, so rendering a hold is a single lookup
+  LED_MAP_LAYOUT_n_HOLD_ABOVE_TABLE  - LED number of the position above each hold number (LED_MAP_NONE in the top row)
+  LED_MAP_LAYOUT_n_POSITION_TABLE    - position of each hold number, for rebuilding the map for a runtime wiring
+and LED_MAP_FOR_EACH_LAYOUT(fn), which calls fn(n) for each of them.
+"""
+
+import argparse
+import re
+import sys
+
+LED_MAP_NONE = 0xFFFF
+MAX_COLUMN_LEDS = 64  # skipped LEDs are held in a 64-bit mask at runtime
+
+# Built-in layouts: (rows, columns, hold numbering). Custom layouts are given with --rows, --cols and --numbering.
+LAYOUTS = {
+    "moonboard": (18, 11, "serpentine"),  # MoonBoard 2016, 2019 and 2024
+    "mini": (12, 11, "serpentine"),  # Mini MoonBoard
+}
+
+
+def parse_led_list(text):
+    return [int(v, 0) for v in re.split(r"[\s,]+", text.strip()) if v]
+
+
+def zigzag_map(rows, cols, first_led_right, first_led_bottom, skip):
+    """Wiring runs zig-zag up and down the columns, skipping the given LEDs in every column.
+
+    This must produce the same map as led_map_set_wiring() in led_map.c.
+    """
+    led_map = [0] * (rows * cols)
+    leds_in_col = rows + len(skip)  # number of LEDs in each column including skipped LEDs
+    for wired_col in range(cols):
+        col = cols - 1 - wired_col if first_led_right else wired_col
+        # The first column is wired down unless the first LED is at the bottom, and each column reverses direction
+        goes_down = (wired_col % 2 == 0) != first_led_bottom
+        row = rows - 1 if goes_down else 0
+        for pos in range(leds_in_col):
+            # Every other column is wired in the opposite direction, so the skipped positions are mirrored
+            if (pos if wired_col % 2 == 0 else leds_in_col - 1 - pos) in skip:
+                continue
+            led_map[col * rows + row] = wired_col * leds_in_col + pos
+            row += -1 if goes_down else 1
+    return led_map
+
+
+def hold_positions(rows, cols, numbering):
+    """Position (col * rows + row) of each hold number. Numbering starts at #0 in the bottom-left corner."""
+    positions = []
+    if numbering == "rows":  # along each row, from the bottom row up
+        for row in range(rows):
+            positions += [col * rows + row for col in range(cols)]
+        return positions
+    for col in range(cols):
+        # MoonBoard (serpentine) numbering runs up the first column, down the next, and so on
+        down = numbering == "serpentine" and col % 2 == 1
+        positions += [col * rows + (rows - 1 - r if down else r) for r in range(rows)]
+    return positions
+
+
+def format_table(name, values, per_line):
+    lines = [f"#define {name} {{ \\"]
+    for i in range(0, len(values), per_line):
+        chunk = ", ".join(f"{v:#06x}" if v == LED_MAP_NONE else str(v) for v in values[i : i + per_line])
+        lines.append(f"\t{chunk}, \\")
+    lines.append("}")
+    return "\n".join(lines)
+
+
+def generate_layout(index, name, rows, cols, numbering, args):
+    """Returns the lines describing one layout, and the wiring source and skip list it was built with"""
+    if args.custom_map:
+        with open(args.custom_map, encoding="utf-8") as f:
+            led_map = parse_led_list(re.sub(r"(#|//).*", "", f.read()))
+        if len(led_map) != rows * cols:
+            sys.exit(f"{args.custom_map}: expected {rows * cols} LED numbers, found {len(led_map)}")
+        source = f"custom map {args.custom_map}"
+        skip = []
+    else:
+        skip = parse_led_list(args.skip)
+        leds_in_col = rows + len(skip)
+        if leds_in_col > MAX_COLUMN_LEDS or len(set(skip)) != len(skip) or any(n < 0 or n >= leds_in_col for n in skip):
+            sys.exit(f"Invalid skip list {args.skip}: LED numbers must be unique and within the column")
+        led_map = zigzag_map(rows, cols, args.first_led_right, args.first_led_bottom, skip)
+        source = (
+            f"zig-zag wiring, first LED {'right' if args.first_led_right else 'left'}"
+            f"/{'bottom' if args.first_led_bottom else 'top'}, skip [{', '.join(map(str, skip))}]"
+        )
+
+    positions = hold_positions(rows, cols, numbering)
+    holds = [led_map[pos] for pos in positions]
+    holds_above = [led_map[pos + 1] if pos % rows != rows - 1 else LED_MAP_NONE for pos in positions]
+    prefix = f"LED_MAP_LAYOUT_{index}"
+    lines = [
+        f"// {name}: {cols} columns by {rows} rows, {numbering} hold numbering",
+        f'#define {prefix}_NAME "{name}"',
+        f"#define {prefix}_ROWS {rows}",
+        f"#define {prefix}_COLS {cols}",
+        f"#define {prefix}_MAX_LED {max(led_map)}",
+        format_table(f"{prefix}_TABLE", led_map, rows),
+        format_table(f"{prefix}_HOLD_TABLE", holds, rows),
+        format_table(f"{prefix}_HOLD_ABOVE_TABLE", holds_above, rows),
+        format_table(f"{prefix}_POSITION_TABLE", positions, rows),
+        "",
+    ]
+    return lines, source, skip
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--output", required=True, help="generated header to write")
+    parser.add_argument("--layout", default="moonboard", help=f"one of {', '.join(LAYOUTS)}, or custom")
+    parser.add_argument("--rows", type=int, help="rows of a custom layout")
+    parser.add_argument("--cols", type=int, help="columns of a custom layout")
+    parser.add_argument("--numbering", choices=("serpentine", "columns", "rows"), default="serpentine",
+                        help="hold numbering of a custom layout")
+    parser.add_argument("--all-layouts", action="store_true",
+                        help="also build in the other built-in layouts, so they can be chosen at runtime")
+    parser.add_argument("--first-led-right", action="store_true", help="columns are wired right to left")
+    parser.add_argument("--first-led-bottom", action="store_true", help="first LED is at the bottom of its column")
+    parser.add_argument("--skip", default="", help="LED numbers to skip in the first column, e.g. 6,7,14,15")
+    parser.add_argument("--custom-map", help="file listing the LED number for every position, in the TABLE order")
+    args = parser.parse_args()
+
+    if args.layout == "custom":
+        if not args.rows or not args.cols:
+            sys.exit("A custom layout needs --rows and --cols")
+        layouts = [("custom", args.rows, args.cols, args.numbering)]
+    elif args.layout in LAYOUTS:
+        layouts = [(args.layout, *LAYOUTS[args.layout])]
+    else:
+        sys.exit(f"Unknown layout {args.layout}")
+    if args.all_layouts:
+        if args.custom_map:
+            sys.exit("A custom map only fits one layout, so the layout can't be chosen at runtime")
+        layouts += [(name, *LAYOUTS[name]) for name in LAYOUTS if name != layouts[0][0]]
+
+    tables = []
+    for index, (name, rows, cols, numbering) in enumerate(layouts):
+        lines, source, skip = generate_layout(index, name, rows, cols, numbering, args)
+        tables += lines
+
+    out = [
+        "// Generated by scripts/gen_led_map.py - do not edit",
+        f"// {source}",
+        "",
+        "#ifndef _LED_MAP_GENERATED_H",
+        "#define _LED_MAP_GENERATED_H",
+        "",
+        f"#define LED_MAP_NUM_LAYOUTS {len(layouts)}",
+        f"#define LED_MAP_FOR_EACH_LAYOUT(fn) {' '.join(f'fn({i})' for i in range(len(layouts)))}",
+        f"#define LED_MAP_MAX_POSITIONS {max(rows * cols for _, rows, cols, _ in layouts)}",
+        "",
+        "// The layout selected at build time",
+        "#define LED_MAP_GENERATED_ROWS LED_MAP_LAYOUT_0_ROWS",
+        "#define LED_MAP_GENERATED_COLS LED_MAP_LAYOUT_0_COLS",
+        "#define LED_MAP_GENERATED_MAX_LED LED_MAP_LAYOUT_0_MAX_LED",
+        "",
+    ]
+    if args.custom_map:
+        out.append("#define LED_MAP_GENERATED_CUSTOM 1")
+    else:
+        out += [
+            f"#define LED_MAP_GENERATED_FIRST_LED_RIGHT {int(args.first_led_right)}",
+            f"#define LED_MAP_GENERATED_FIRST_LED_BOTTOM {int(args.first_led_bottom)}",
+            f"#define LED_MAP_GENERATED_SKIP_MASK {sum(1 << n for n in skip):#x}ULL",
+        ]
+    out += [""] + tables + [
+        "#endif // _LED_MAP_GENERATED_H",
+        "",
+    ]
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write("\n".join(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Converts zboard text problems to binary problem frames.
+
+Reads text problems (one per line, e.g. "~D#S12,P45,E197#", "l#S1,E2#", "t12,45#") and writes the
+equivalent binary frames, as described in src/zboard.c:
+
+  0xB5 <flags> <count> <hold>{count} <crc16>
+
+With --library, the problems are built into a problem library (see src/problem_library.h) instead, and
+the output is the stream of library frames that uploads it. Each line may start with "<id>:" to give the
+problem's library ID, otherwise its line number is used. --show adds a "p<id>#" command for every line.
+
+Usage: zboard_proto.py [input.txt] [-o output.bin] [--library [--show] [--image library.img]]
+"""
+
+import argparse
+import re
+import sys
+
+BIN_FRAME_START = 0xB5
+BIN_FLAG_ADDITIONAL_LEDS = 0x01
+BIN_FLAG_NO_LED_MAPPING = 0x02
+PROBLEM_MAX_HOLDS = 64
+HOLD_NUM_BITS = 12
+LIB_FRAME_START = 0xB6
+LIB_OP_BEGIN = ord("B")
+LIB_OP_WRITE = ord("W")
+LIB_OP_FINISH = ord("E")
+# A multiple of the 4 byte flash write block that keeps each upload frame (1+1+1+4+232+2 = 241 bytes) within
+# one ATT write at an MTU of 247, which carries 244 bytes
+LIB_CHUNK = 232
+LIBRARY_MAGIC = b"ZBL1"
+HOLD_TYPES = {"S": 1, "P": 2, "E": 3, "L": 4, "R": 5, "M": 6, "F": 7}  # hold_type_t in zboard.h
+
+
+def crc16_ccitt(seed, data):
+    """Same as Zephyr's crc16_ccitt(); seeded with 0xFFFF this is CRC-16/MCRF4XX."""
+    for b in data:
+        e = (seed ^ b) & 0xFF
+        f = (e ^ (e << 4)) & 0xFF
+        seed = ((seed >> 8) ^ (f << 8) ^ (f << 3) ^ (f >> 4)) & 0xFFFF
+    return seed
+
+
+def encode_problem(holds, additional_leds=False, led_mapping=True):
+    """Encodes <flags> <count> <hold>{count}. holds is a list of (type letter, hold number) pairs"""
+    if len(holds) > PROBLEM_MAX_HOLDS:
+        raise ValueError(f"too many holds ({len(holds)})")
+    flags = (BIN_FLAG_ADDITIONAL_LEDS if additional_leds else 0) | (0 if led_mapping else BIN_FLAG_NO_LED_MAPPING)
+    body = bytearray([flags, len(holds)])
+    for hold_type, num in holds:
+        if num >= (1 << HOLD_NUM_BITS):
+            raise ValueError(f"hold number {num} out of range")
+        body += ((HOLD_TYPES.get(hold_type.upper(), 0) << HOLD_NUM_BITS) | num).to_bytes(2, "big")
+    return bytes(body)
+
+
+def encode_frame(holds, additional_leds=False, led_mapping=True):
+    body = encode_problem(holds, additional_leds, led_mapping)
+    return bytes([BIN_FRAME_START]) + body + crc16_ccitt(0xFFFF, body).to_bytes(2, "big")
+
+
+def build_library(problems):
+    """problems maps ID to (holds, additional_leds, led_mapping). Returns the library image."""
+    ids = sorted(problems)
+    index = bytearray()
+    records = bytearray()
+    records_start = 8 + 8 * len(ids)
+    for problem_id in ids:
+        index += problem_id.to_bytes(4, "big") + (records_start + len(records)).to_bytes(4, "big")
+        records += encode_problem(*problems[problem_id])
+    return LIBRARY_MAGIC + len(ids).to_bytes(2, "big") + bytes(2) + bytes(index) + bytes(records)
+
+
+def library_frame(op, payload=b""):
+    body = bytes([op, len(payload)]) + payload
+    return bytes([LIB_FRAME_START]) + body + crc16_ccitt(0xFFFF, body).to_bytes(2, "big")
+
+
+def library_upload(image):
+    """Returns the library frames that upload the image. Send each after the reply to the one before."""
+    frames = [library_frame(LIB_OP_BEGIN, len(image).to_bytes(4, "big"))]
+    for offset in range(0, len(image), LIB_CHUNK):
+        frames.append(library_frame(LIB_OP_WRITE, offset.to_bytes(4, "big") + image[offset:offset + LIB_CHUNK]))
+    frames.append(library_frame(LIB_OP_FINISH))
+    return frames
+
+
+def parse_text_problem(line):
+    """Returns (holds, additional_leds, led_mapping) for a text problem, or None if it isn't one"""
+    m = re.fullmatch(r"(~[Dl]|[Ll])#(.*)#", line)
+    if m:
+        holds = [(spec[0], int(spec[1:])) for spec in m.group(2).split(",") if len(spec) > 1]
+        return holds, m.group(1) == "~D", True
+    m = re.fullmatch(r"([tTxXaA])(.*)#", line)
+    if m:
+        holds = [("P", int(spec)) for spec in m.group(2).split(",") if spec]
+        mode = m.group(1).lower()
+        return holds, mode == "a", mode != "x"
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", nargs="?", type=argparse.FileType("r"), default=sys.stdin)
+    parser.add_argument("-o", "--output", type=argparse.FileType("wb"), default=sys.stdout.buffer)
+    parser.add_argument("--library", action="store_true", help="output the upload of a problem library")
+    parser.add_argument("--show", action="store_true", help="with --library, show each problem after the upload")
+    parser.add_argument("--image", type=argparse.FileType("wb"), help="with --library, also write the library image")
+    args = parser.parse_args()
+
+    library = {}
+    shows = []
+    for lineno, line in enumerate(args.input, 1):
+        line = line.strip()
+        if not line:
+            continue
+        problem_id = lineno
+        m = re.fullmatch(r"(\d+):(.*)", line)
+        if m and args.library:
+            problem_id, line = int(m.group(1)), m.group(2)
+        problem = parse_text_problem(line)
+        if problem is None:
+            sys.exit(f"line {lineno}: not a problem: {line}")
+        if not args.library:
+            args.output.write(encode_frame(*problem))
+            continue
+        if library.get(problem_id, problem) != problem:
+            sys.exit(f"line {lineno}: problem {problem_id} is already in the library")
+        library[problem_id] = problem
+        shows.append(problem_id)
+
+    if args.library:
+        image = build_library(library)
+        if args.image:
+            args.image.write(image)
+        for frame in library_upload(image):
+            args.output.write(frame)
+        for problem_id in shows if args.show else []:
+            args.output.write(f"p{problem_id}#".encode())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""Decodes the event trace dumped by the zboard 'd' command.
+
+The dump is a "trace <count> <cycles per second>" line followed by one line per event of
+"<cycles> <event> <a> <b>" in hex, oldest first (see src/trace.h). Anything else in the capture, such as
+the replies to other commands, is skipped. Each event is printed with its time relative to the first
+one in the dump.
+
+Usage: zboard_trace.py [capture.txt]
+"""
+
+import argparse
+import sys
+
+HOLD_NUM_BITS = 12
+HOLD_TYPE_CHARS = "?SPELRMF"  # hold_type_chars in zboard.c
+INPUT_NAMES = {}  # Filled in by --max-conn: inputs are one per BLE connection, then the UART
+
+
+def hold(packed):
+    return f"{HOLD_TYPE_CHARS[(packed >> HOLD_NUM_BITS) & 0xF]}{packed & ((1 << HOLD_NUM_BITS) - 1)}"
+
+
+def signed(value):
+    return value - (1 << 32) if value & (1 << 31) else value
+
+
+def input_name(index):
+    return INPUT_NAMES.get(index, f"conn {index}")
+
+
+# trace_event_id_t in src/trace.h, in order
+EVENTS = [
+    ("rx", lambda a, b: f"{input_name(a)}: {b} bytes"),
+    ("rx break", lambda a, b: f"{input_name(a)}: {b} bytes dropped so far"),
+    ("problem complete", lambda a, b: f"{input_name(a)}: {b} holds"),
+    ("problem dropped", lambda a, b: f"{a} holds"),
+    ("render start", lambda a, b: f"{a} holds"),
+    ("cache hit", lambda a, b: f"hash {b:08x}"),
+    ("hold", lambda a, b: f"{hold(a)} -> LED {b}"),
+    ("additional LED", lambda a, b: f"{hold(a)} -> LED {b}"),
+    ("hold out of range", lambda a, b: hold(a)),
+    ("render done", lambda a, b: f"{a} LEDs, result {signed(b)}"),
+    ("pattern frame", lambda a, b: f"frame {a}"),
+    ("playlist show", lambda a, b: f"entry {a}, {'prefetched' if b else 'composed'}"),
+    ("strip power", lambda a, b: f"{'on' if a else 'off'} after {b} ms"),
+]
+
+
+def decode(lines):
+    """Yields (seconds since the first event, event name, description) for each event in the dump"""
+    hz = None
+    first = None
+    elapsed = 0
+    last = None
+    for line in lines:
+        fields = line.split()
+        if len(fields) == 3 and fields[0] == "trace":
+            hz = int(fields[2])
+            first = None
+            continue
+        if hz is None or len(fields) != 4:
+            continue
+        try:
+            cycles, event, a, b = (int(f, 16) for f in fields)
+        except ValueError:
+            continue
+        if first is None:
+            first = last = cycles
+            elapsed = 0
+        elapsed += (cycles - last) & 0xFFFFFFFF  # The cycle counter wraps
+        last = cycles
+        if event < len(EVENTS):
+            name, describe = EVENTS[event]
+            yield elapsed / hz, name, describe(a, b)
+        else:
+            yield elapsed / hz, f"event {event}", f"{a:x} {b:x}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", nargs="?", type=argparse.FileType("r"), default=sys.stdin)
+    parser.add_argument("--max-conn", type=int, default=4, help="CONFIG_BT_MAX_CONN, to name the UART input")
+    args = parser.parse_args()
+    INPUT_NAMES[args.max_conn] = "uart"
+    for seconds, name, description in decode(args.input):
+        print(f"{seconds * 1e3:12.3f} ms  {name:<18} {description}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,257 @@
+#include "ble_link.h"
+
+#include "zboard.h"
+
+#include <zephyr/bluetooth/gap.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#define LOG_LEVEL LOG_LEVEL_INF
+LOG_MODULE_REGISTER(ble_link);
+
+// The supervision timeout (in units of 10 ms) must be longer than (1 + latency) * interval max * 2, and is
+// at least 4 s so that a connection survives a few missed events
+#define SUPERVISION_TIMEOUT(_latency, _intervalMax) MAX(400, ((1 + (_latency)) * (_intervalMax)) / 4 + 1)
+#define FAST_TIMEOUT SUPERVISION_TIMEOUT(0, CONFIG_ZBOARD_BLE_FAST_INTERVAL_MAX)
+#define IDLE_TIMEOUT SUPERVISION_TIMEOUT(CONFIG_ZBOARD_BLE_IDLE_LATENCY, CONFIG_ZBOARD_BLE_IDLE_INTERVAL_MAX)
+
+BUILD_ASSERT(FAST_TIMEOUT <= 3200 && IDLE_TIMEOUT <= 3200, "Connection intervals need a supervision timeout over 32 s");
+BUILD_ASSERT(CONFIG_ZBOARD_BLE_FAST_INTERVAL_MIN <= CONFIG_ZBOARD_BLE_FAST_INTERVAL_MAX, "Fast interval range is empty");
+BUILD_ASSERT(CONFIG_ZBOARD_BLE_IDLE_INTERVAL_MIN <= CONFIG_ZBOARD_BLE_IDLE_INTERVAL_MAX, "Idle interval range is empty");
+
+static const struct bt_le_conn_param fastParam = BT_LE_CONN_PARAM_INIT(
+	CONFIG_ZBOARD_BLE_FAST_INTERVAL_MIN, CONFIG_ZBOARD_BLE_FAST_INTERVAL_MAX, 0, FAST_TIMEOUT);
+static const struct bt_le_conn_param idleParam = BT_LE_CONN_PARAM_INIT(
+	CONFIG_ZBOARD_BLE_IDLE_INTERVAL_MIN, CONFIG_ZBOARD_BLE_IDLE_INTERVAL_MAX, CONFIG_ZBOARD_BLE_IDLE_LATENCY,
+	IDLE_TIMEOUT);
+
+typedef struct bleLink
+{
+	struct bt_conn *conn;
+	struct k_work negotiateWork; // Asks for the PHY, data length, MTU and interval once connected
+	struct k_work paramWork;	 // Asks for the fast or relaxed interval, whichever info.bIdle says
+	struct k_timer idleTimer;
+	struct bt_gatt_exchange_params mtuParams;
+	ble_link_info_t info;
+} ble_link_t;
+
+static ble_link_t links[CONFIG_BT_MAX_CONN];
+static struct k_spinlock linkLock; // Protects the info of each link, which the Bluetooth RX thread updates
+
+// Takes a reference to the link's connection, or returns NULL if the client has gone, so that work that
+// was queued before a disconnect doesn't use a released connection
+static struct bt_conn *linkConn(ble_link_t *link, bool *bIdle)
+{
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	struct bt_conn *conn = link->conn ? bt_conn_ref(link->conn) : NULL;
+	if (bIdle)
+	{
+		*bIdle = link->info.bIdle;
+	}
+	k_spin_unlock(&linkLock, key);
+	return conn;
+}
+
+// The requests are made from the system workqueue, since they wait for the controller and the connection
+// callbacks run in the Bluetooth RX thread
+static void negotiate(struct k_work *work)
+{
+	ble_link_t *link = CONTAINER_OF(work, ble_link_t, negotiateWork);
+	struct bt_conn *conn = linkConn(link, NULL);
+	if (!conn)
+	{
+		return;
+	}
+	int err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+	if (err)
+	{
+		LOG_WRN("Client %d: 2M PHY request failed: %d", bt_conn_index(conn), err);
+	}
+	err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err)
+	{
+		LOG_WRN("Client %d: data length request failed: %d", bt_conn_index(conn), err);
+	}
+	err = bt_gatt_exchange_mtu(conn, &link->mtuParams);
+	if (err)
+	{
+		LOG_WRN("Client %d: MTU exchange failed: %d", bt_conn_index(conn), err);
+	}
+	err = bt_conn_le_param_update(conn, &fastParam);
+	if (err)
+	{
+		LOG_WRN("Client %d: connection parameter request failed: %d", bt_conn_index(conn), err);
+	}
+	bt_conn_unref(conn);
+}
+
+static void requestInterval(struct k_work *work)
+{
+	ble_link_t *link = CONTAINER_OF(work, ble_link_t, paramWork);
+	bool bIdle;
+	struct bt_conn *conn = linkConn(link, &bIdle);
+	if (!conn)
+	{
+		return;
+	}
+	int err = bt_conn_le_param_update(conn, bIdle ? &idleParam : &fastParam);
+	if (err)
+	{
+		LOG_WRN("Client %d: connection parameter request failed: %d", bt_conn_index(conn), err);
+	}
+	bt_conn_unref(conn);
+}
+
+static void idleTimerExpired(struct k_timer *timer)
+{
+	ble_link_t *link = CONTAINER_OF(timer, ble_link_t, idleTimer);
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	link->info.bIdle = true;
+	link->info.relaxes++;
+	k_spin_unlock(&linkLock, key);
+	k_work_submit(&link->paramWork);
+}
+
+void ble_link_activity(struct bt_conn *conn)
+{
+	ble_link_t *link = &links[bt_conn_index(conn)];
+	k_timer_start(&link->idleTimer, K_MSEC(CONFIG_ZBOARD_BLE_IDLE_DELAY_MS), K_NO_WAIT);
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	bool bWasIdle = link->info.bIdle;
+	link->info.bIdle = false;
+	k_spin_unlock(&linkLock, key);
+	if (bWasIdle)
+	{
+		k_work_submit(&link->paramWork);
+	}
+}
+
+static void mtuExchanged(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+	if (err)
+	{
+		LOG_WRN("Client %d: MTU exchange failed: 0x%02x", bt_conn_index(conn), err);
+	}
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err)
+	{
+		return;
+	}
+	ble_link_t *link = &links[bt_conn_index(conn)];
+	struct bt_conn_info connInfo;
+	bt_conn_get_info(conn, &connInfo);
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	link->conn = bt_conn_ref(conn);
+	// What every connection starts with, until the updates come in
+	link->info = (ble_link_info_t){
+		.bConnected = true,
+		.txPhy = BT_GAP_LE_PHY_1M,
+		.rxPhy = BT_GAP_LE_PHY_1M,
+		.txMaxLen = BT_GAP_DATA_LEN_DEFAULT,
+		.rxMaxLen = BT_GAP_DATA_LEN_DEFAULT,
+		.mtu = bt_gatt_get_mtu(conn),
+		.interval = connInfo.le.interval,
+		.latency = connInfo.le.latency,
+		.timeout = connInfo.le.timeout,
+	};
+	k_spin_unlock(&linkLock, key);
+	k_timer_start(&link->idleTimer, K_MSEC(CONFIG_ZBOARD_BLE_IDLE_DELAY_MS), K_NO_WAIT);
+	k_work_submit(&link->negotiateWork);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	ble_link_t *link = &links[bt_conn_index(conn)];
+	k_timer_stop(&link->idleTimer);
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	struct bt_conn *old = link->conn;
+	link->conn = NULL;
+	link->info.bConnected = false;
+	k_spin_unlock(&linkLock, key);
+	if (old)
+	{
+		bt_conn_unref(old);
+	}
+}
+
+static void paramUpdated(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+	ble_link_t *link = &links[bt_conn_index(conn)];
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	link->info.interval = interval;
+	link->info.latency = latency;
+	link->info.timeout = timeout;
+	k_spin_unlock(&linkLock, key);
+	LOG_INF("Client %d: interval %u.%02u ms, latency %u", bt_conn_index(conn), interval * 5 / 4, (interval * 125) % 100,
+			latency);
+}
+
+static void phyUpdated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	ble_link_t *link = &links[bt_conn_index(conn)];
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	link->info.txPhy = param->tx_phy;
+	link->info.rxPhy = param->rx_phy;
+	k_spin_unlock(&linkLock, key);
+	LOG_INF("Client %d: PHY tx %u rx %u", bt_conn_index(conn), param->tx_phy, param->rx_phy);
+}
+
+static void dataLenUpdated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	ble_link_t *link = &links[bt_conn_index(conn)];
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	link->info.txMaxLen = info->tx_max_len;
+	link->info.rxMaxLen = info->rx_max_len;
+	k_spin_unlock(&linkLock, key);
+	LOG_INF("Client %d: data length tx %u rx %u", bt_conn_index(conn), info->tx_max_len, info->rx_max_len);
+}
+
+// Phones usually start the exchange themselves, so this is also how their MTU is found out
+static void mtuUpdated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+	ble_link_t *link = &links[bt_conn_index(conn)];
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	link->info.mtu = MIN(tx, rx);
+	k_spin_unlock(&linkLock, key);
+	LOG_INF("Client %d: MTU %u", bt_conn_index(conn), MIN(tx, rx));
+}
+
+static struct bt_conn_cb linkConnCb = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = paramUpdated,
+	.le_phy_updated = phyUpdated,
+	.le_data_len_updated = dataLenUpdated,
+};
+
+static struct bt_gatt_cb linkGattCb = {
+	.att_mtu_updated = mtuUpdated,
+};
+
+int ble_link_init(void)
+{
+	for (int i = 0; i < CONFIG_BT_MAX_CONN; i++)
+	{
+		ble_link_t *link = &links[i];
+		k_work_init(&link->negotiateWork, negotiate);
+		k_work_init(&link->paramWork, requestInterval);
+		k_timer_init(&link->idleTimer, idleTimerExpired, NULL);
+		link->mtuParams.func = mtuExchanged;
+	}
+	bt_gatt_cb_register(&linkGattCb);
+	return bt_conn_cb_register(&linkConnCb);
+}
+
+int ble_link_get_info(uint8_t index, ble_link_info_t *info)
+{
+	if (index >= CONFIG_BT_MAX_CONN)
+	{
+		return -EINVAL;
+	}
+	k_spinlock_key_t key = k_spin_lock(&linkLock);
+	*info = links[index].info;
+	k_spin_unlock(&linkLock, key);
+	return info->bConnected ? 0 : -ENOTCONN;
+}
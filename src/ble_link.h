@@ -0,0 +1,37 @@
+#ifndef _BLE_LINK_H
+#define _BLE_LINK_H
+
+// Negotiates the link parameters of each BLE connection (CONFIG_ZBOARD_BLE_LINK). Left to the phone, a
+// connection runs on the 1M PHY with 27 byte link layer packets, a 23 byte ATT MTU and whatever interval the
+// phone picks, so a problem takes several connection events to arrive. Once a client connects it is asked for
+// the 2M PHY, the longest data length, an MTU exchange and a short connection interval. After
+// CONFIG_ZBOARD_BLE_IDLE_DELAY_MS without any data the interval is relaxed to save power, and the next write
+// asks for the short one again.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/bluetooth/conn.h>
+
+typedef struct bleLinkInfo
+{
+    bool bConnected;
+    bool bIdle;        // running at the relaxed interval
+    uint8_t txPhy;     // BT_GAP_LE_PHY_1M, BT_GAP_LE_PHY_2M or BT_GAP_LE_PHY_CODED
+    uint8_t rxPhy;
+    uint16_t txMaxLen; // link layer payload, in bytes
+    uint16_t rxMaxLen;
+    uint16_t mtu;      // ATT MTU
+    uint16_t interval; // in units of 1.25 ms
+    uint16_t latency;  // connection events the peripheral may skip
+    uint16_t timeout;  // supervision timeout, in units of 10 ms
+    uint32_t relaxes;  // times the interval was relaxed after going idle
+} ble_link_info_t;
+
+int ble_link_init(void);
+// Called for each write from the client, from the Bluetooth RX thread
+void ble_link_activity(struct bt_conn *conn);
+// Fills in the link parameters of connection slot index. Returns -ENOTCONN if nobody is connected there.
+int ble_link_get_info(uint8_t index, ble_link_info_t *info);
+
+#endif // _BLE_LINK_H
@@ -0,0 +1,150 @@
+#include "compositor.h"
+
+#include <string.h>
+
+#define DIRTY_WORDS DIV_ROUND_UP(STRIP_LENGTH, 32)
+#define TRANSPARENT_PAIR ((LAYER_TRANSPARENT << 4) | LAYER_TRANSPARENT)
+
+static layer_frame_t layers[NUM_LAYERS];
+static uint32_t dirty[NUM_LAYERS][DIRTY_WORDS]; // Bit per LED changed since the last commit
+static K_MUTEX_DEFINE(compositorLock);
+
+static inline uint8_t layerIndex(const layer_frame_t *frame, int ledNum)
+{
+	return (frame->indices[ledNum >> 1] >> ((ledNum & 1) * 4)) & 0x0F;
+}
+
+static inline void markDirty(layer_id_t layer, int ledNum)
+{
+	dirty[layer][ledNum >> 5] |= BIT(ledNum & 31);
+}
+
+// Marks the LEDs of a pair of nibbles that differ between two bytes of a layer
+static void markPairDirty(layer_id_t layer, int pair, uint8_t before, uint8_t after)
+{
+	uint8_t changed = before ^ after;
+	if (changed & 0x0F)
+	{
+		markDirty(layer, pair * 2);
+	}
+	if ((changed & 0xF0) && pair * 2 + 1 < STRIP_LENGTH)
+	{
+		markDirty(layer, pair * 2 + 1);
+	}
+}
+
+void compositor_init(void)
+{
+	memset(layers, TRANSPARENT_PAIR, sizeof(layers));
+	memset(dirty, 0xFF, sizeof(dirty)); // The first commit draws every LED
+}
+
+void compositor_begin(void)
+{
+	k_mutex_lock(&compositorLock, K_FOREVER);
+}
+
+void compositor_end(void)
+{
+	k_mutex_unlock(&compositorLock);
+}
+
+void compositor_set(layer_id_t layer, uint16_t ledNum, const color_t *color)
+{
+	uint8_t before = layers[layer].indices[ledNum >> 1];
+	layer_frame_set(&layers[layer], ledNum, color);
+	if (layers[layer].indices[ledNum >> 1] != before)
+	{
+		markDirty(layer, ledNum);
+	}
+}
+
+void compositor_clear(layer_id_t layer)
+{
+	for (int i = 0; i < sizeof(layers[layer].indices); i++)
+	{
+		uint8_t before = layers[layer].indices[i];
+		if (before != TRANSPARENT_PAIR)
+		{
+			layers[layer].indices[i] = TRANSPARENT_PAIR;
+			markPairDirty(layer, i, before, TRANSPARENT_PAIR);
+		}
+	}
+}
+
+void compositor_load(layer_id_t layer, const layer_frame_t *frame)
+{
+	for (int i = 0; i < sizeof(layers[layer].indices); i++)
+	{
+		uint8_t before = layers[layer].indices[i];
+		if (before != frame->indices[i])
+		{
+			layers[layer].indices[i] = frame->indices[i];
+			markPairDirty(layer, i, before, frame->indices[i]);
+		}
+	}
+}
+
+const layer_frame_t *compositor_layer(layer_id_t layer)
+{
+	return &layers[layer];
+}
+
+void layer_frame_set(layer_frame_t *frame, uint16_t ledNum, const color_t *color)
+{
+	uint8_t *pair = &frame->indices[ledNum >> 1];
+	*pair = (ledNum & 1) ? ((*pair & 0x0F) | (color->index << 4)) : ((*pair & 0xF0) | color->index);
+}
+
+void layer_frame_clear(layer_frame_t *frame)
+{
+	memset(frame->indices, TRANSPARENT_PAIR, sizeof(frame->indices));
+}
+
+// The colour of the topmost layer that isn't transparent at the LED
+static const color_t *compositeLED(int ledNum)
+{
+	for (int layer = NUM_LAYERS - 1; layer >= 0; layer--)
+	{
+		uint8_t index = layerIndex(&layers[layer], ledNum);
+		if (index != LAYER_TRANSPARENT)
+		{
+			return &color_list[index];
+		}
+	}
+	return &COLOR_BLACK;
+}
+
+int compositor_commit(void)
+{
+	led_output_begin(false);
+	for (int w = 0; w < DIRTY_WORDS; w++)
+	{
+		uint32_t changed = 0;
+		for (int layer = 0; layer < NUM_LAYERS; layer++)
+		{
+			changed |= dirty[layer][w];
+			dirty[layer][w] = 0;
+		}
+		while (changed)
+		{
+			int ledNum = w * 32 + __builtin_ctz(changed);
+			changed &= changed - 1;
+			if (ledNum < STRIP_LENGTH)
+			{
+				led_output_set(ledNum, compositeLED(ledNum));
+			}
+		}
+	}
+	int err = led_output_flip(); // Sends nothing if no LED has actually changed colour
+	k_mutex_unlock(&compositorLock);
+	return err;
+}
+
+int compositor_show_problem(const problem_frame_t *frame)
+{
+	compositor_begin();
+	compositor_load(LAYER_PROBLEM, &frame->holds);
+	compositor_load(LAYER_MARKERS, &frame->markers);
+	return compositor_commit();
+}
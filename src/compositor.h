@@ -0,0 +1,64 @@
+#ifndef _COMPOSITOR_H
+#define _COMPOSITOR_H
+
+// Builds each frame from ordered layers, so that producers only draw their own content: patterns on the
+// animation layer, markers such as the LEDs above holds on the marker layer, and problems on the problem layer.
+// Markers are below the problem so that a hold directly above another hold still shows its own colour.
+// Each LED of a layer is a colour from color_list[] or transparent, and shows the topmost layer that isn't
+// transparent there (or black). Every layer keeps a mask of the LEDs that changed since the last commit,
+// and compositor_commit() only recomposites those LEDs into a copy of the frame the strip is showing, so
+// e.g. an animation behind a problem only costs the LEDs it changes.
+//
+// Layers are changed between compositor_begin() and compositor_commit() (or compositor_end() to leave the
+// changes for the next commit), which hold a lock so any thread can draw.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "zboard.h"
+
+typedef enum layerId
+{
+    LAYER_ANIMATION, // Bottom
+    LAYER_MARKERS,
+    LAYER_PROBLEM, // Top
+    NUM_LAYERS
+} layer_id_t;
+
+#define LAYER_TRANSPARENT 0x0F // Not a color_list[] index
+
+// A 4-bit color_list[] index or LAYER_TRANSPARENT per LED, the even numbered LED in the low nibble
+typedef struct layerFrame
+{
+    uint8_t indices[DIV_ROUND_UP(STRIP_LENGTH, 2)];
+} layer_frame_t;
+
+// What a problem draws: its holds on LAYER_PROBLEM and the markers above them on LAYER_MARKERS
+typedef struct problemFrame
+{
+    layer_frame_t holds;
+    layer_frame_t markers;
+} problem_frame_t;
+
+void compositor_init(void);
+void compositor_begin(void);
+// Composites the LEDs that changed on any layer and sends the frame, then releases the lock
+int compositor_commit(void);
+// Releases the lock without sending anything
+void compositor_end(void);
+
+void compositor_set(layer_id_t layer, uint16_t ledNum, const color_t *color);
+// Makes the whole layer transparent
+void compositor_clear(layer_id_t layer);
+// Replaces the whole layer, e.g. with a frame saved by the problem cache
+void compositor_load(layer_id_t layer, const layer_frame_t *frame);
+const layer_frame_t *compositor_layer(layer_id_t layer);
+
+// Shows a problem in place of the one showing, in a single update without a blank frame in between
+int compositor_show_problem(const problem_frame_t *frame);
+
+// Draw into a layer frame that isn't being shown, e.g. to compose a problem ahead of time
+void layer_frame_set(layer_frame_t *frame, uint16_t ledNum, const color_t *color);
+void layer_frame_clear(layer_frame_t *frame);
+
+#endif // _COMPOSITOR_H
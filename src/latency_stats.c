@@ -0,0 +1,87 @@
+#include "latency_stats.h"
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+const char *const latency_stage_names[NUM_LATENCY_STAGES] = {
+	[LATENCY_PARSE] = "parse",
+	[LATENCY_QUEUE] = "queue",
+	[LATENCY_COMPOSE] = "compose",
+	[LATENCY_SEND] = "send",
+	[LATENCY_TOTAL] = "total",
+};
+
+// Only written by renderProblem(), so readers may see a histogram part way through an update but never
+// corrupt one
+static latency_histogram_t histograms[NUM_LATENCY_STAGES];
+
+// Values below LATENCY_SUB_BUCKETS get a bucket each. Above that, each power of two is split into
+// LATENCY_SUB_BUCKETS buckets by the bits after the most significant one.
+static int bucketOf(uint32_t us)
+{
+	if (us < LATENCY_SUB_BUCKETS)
+	{
+		return us;
+	}
+	int msb = 31 - __builtin_clz(us);
+	int bucket = (msb - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS +
+				 ((us >> (msb - LATENCY_SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+	return MIN(bucket, LATENCY_NUM_BUCKETS - 1);
+}
+
+// Largest value that goes in the bucket
+static uint32_t bucketLimit(int bucket)
+{
+	if (bucket < LATENCY_SUB_BUCKETS)
+	{
+		return bucket;
+	}
+	int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+	uint32_t lower = (uint32_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+	return lower + (1u << shift) - 1;
+}
+
+void latency_stats_record(latency_stage_t stage, uint32_t startCycles, uint32_t endCycles)
+{
+	latency_histogram_t *hist = &histograms[stage];
+	uint32_t us = k_cyc_to_us_floor32(endCycles - startCycles);
+	if (hist->count == 0 || us < hist->minUs)
+	{
+		hist->minUs = us;
+	}
+	hist->maxUs = MAX(hist->maxUs, us);
+	hist->buckets[bucketOf(us)]++;
+	hist->count++;
+}
+
+static uint32_t percentile(const latency_histogram_t *hist, int pct)
+{
+	uint32_t rank = (uint32_t)(((uint64_t)hist->count * pct + 99) / 100); // The rank-th smallest sample
+	uint32_t seen = 0;
+	for (int i = 0; i < LATENCY_NUM_BUCKETS; i++)
+	{
+		seen += hist->buckets[i];
+		if (seen >= rank)
+		{
+			return CLAMP(bucketLimit(i), hist->minUs, hist->maxUs);
+		}
+	}
+	return hist->maxUs;
+}
+
+void latency_stats_summary(latency_stage_t stage, latency_summary_t *summary)
+{
+	const latency_histogram_t *hist = &histograms[stage];
+	memset(summary, 0, sizeof(*summary));
+	summary->count = hist->count;
+	if (hist->count == 0)
+	{
+		return;
+	}
+	summary->minUs = hist->minUs;
+	summary->p50Us = percentile(hist, 50);
+	summary->p99Us = percentile(hist, 99);
+	summary->maxUs = hist->maxUs;
+}
@@ -0,0 +1,50 @@
+#ifndef _LATENCY_STATS_H
+#define _LATENCY_STATS_H
+
+// Histograms of how long each stage of showing a problem takes (CONFIG_ZBOARD_LATENCY_STATS), from
+// cycle counter timestamps taken when the data arrived, when the problem was complete, when rendering
+// started, when the frame was composed and when led_output_flip() returned. Buckets are a quarter of a
+// power of two wide, so percentiles are within 25% and the histograms stay small enough to keep in RAM
+// for the life of the firmware. The 's' input command reports them.
+
+#include <stdint.h>
+
+typedef enum latencyStage
+{
+    LATENCY_PARSE,   // Data received -> final byte of the problem parsed
+    LATENCY_QUEUE,   // Problem complete -> renderProblem() takes it from the queue
+    LATENCY_COMPOSE, // Rendering started -> frame composed (mapped and drawn, or taken from the cache)
+    LATENCY_SEND,    // Frame composed -> handed to the strip
+    LATENCY_TOTAL,   // Data received -> handed to the strip
+    NUM_LATENCY_STAGES
+} latency_stage_t;
+
+#define LATENCY_SUB_BUCKET_BITS 2
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS) // Buckets per power of two
+#define LATENCY_MAX_US_BITS 22 // Anything from 2^22 us (about 4 s) up goes in the last bucket
+#define LATENCY_NUM_BUCKETS ((LATENCY_MAX_US_BITS - 1) * LATENCY_SUB_BUCKETS)
+
+typedef struct latencyHistogram
+{
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t buckets[LATENCY_NUM_BUCKETS];
+} latency_histogram_t;
+
+typedef struct latencySummary
+{
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t p50Us; // Upper bound of the bucket holding the percentile
+    uint32_t p99Us;
+    uint32_t maxUs;
+} latency_summary_t;
+
+extern const char *const latency_stage_names[NUM_LATENCY_STAGES];
+
+// Adds the time from startCycles to endCycles (k_cycle_get_32() values) to the stage's histogram
+void latency_stats_record(latency_stage_t stage, uint32_t startCycles, uint32_t endCycles);
+void latency_stats_summary(latency_stage_t stage, latency_summary_t *summary);
+
+#endif // _LATENCY_STATS_H
@@ -1,107 +1,341 @@
 #include "led_map.h"
 
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
 #define LOG_LEVEL LOG_LEVEL_INF
 LOG_MODULE_REGISTER(led_map);
 
-uint16_t led_map[NUM_PIXELS];
+#define WIRING_SETTINGS_KEY "wiring/config"
+#define LAYOUT_SETTINGS_KEY "layout/name"
+#define LAYOUT_NAME_MAX 16
 
-#ifdef WIRING_LEDS_SKIP_FIRST_COLUMN
-uint8_t ledSkipList[] = {WIRING_LEDS_SKIP_FIRST_COLUMN};
-#else
-uint8_t ledSkipList[] = {};
+// Map for the wiring configured at build time, for each layout that is built in
+#define LAYOUT_TABLES(n)                                                                   \
+	static const uint16_t layout##n##Map[] = LED_MAP_LAYOUT_##n##_TABLE;                   \
+	static const uint16_t layout##n##Holds[] = LED_MAP_LAYOUT_##n##_HOLD_TABLE;            \
+	static const uint16_t layout##n##HoldsAbove[] = LED_MAP_LAYOUT_##n##_HOLD_ABOVE_TABLE; \
+	static const uint16_t layout##n##Positions[] = LED_MAP_LAYOUT_##n##_POSITION_TABLE;
+LED_MAP_FOR_EACH_LAYOUT(LAYOUT_TABLES)
+
+#define LAYOUT_ENTRY(n)                           \
+	{                                             \
+		.name = LED_MAP_LAYOUT_##n##_NAME,        \
+		.rows = LED_MAP_LAYOUT_##n##_ROWS,        \
+		.cols = LED_MAP_LAYOUT_##n##_COLS,        \
+		.maxLED = LED_MAP_LAYOUT_##n##_MAX_LED,   \
+		.map = layout##n##Map,                    \
+		.holds = layout##n##Holds,                \
+		.holdsAbove = layout##n##HoldsAbove,      \
+		.positions = layout##n##Positions,        \
+	},
+
+const led_layout_t led_layouts[LED_MAP_NUM_LAYOUTS] = {LED_MAP_FOR_EACH_LAYOUT(LAYOUT_ENTRY)};
+const led_layout_t *led_layout = &led_layouts[0];
+
+const uint16_t *led_map = layout0Map;
+const uint16_t *led_map_moon = layout0Holds;
+const uint16_t *led_map_moon_above = layout0HoldsAbove;
+
+static uint16_t maxLEDs = UINT16_MAX; // Length of the strip, so that a map can't address LEDs that don't exist
+
+#if defined(CONFIG_ZBOARD_WIRING_RUNTIME) || defined(CONFIG_ZBOARD_LAYOUT_RUNTIME)
+// Points the led_map pointers at the build-time map of the layout in use
+static void useLayoutMap(void)
+{
+	led_map = led_layout->map;
+	led_map_moon = led_layout->holds;
+	led_map_moon_above = led_layout->holdsAbove;
+}
 #endif
 
-uint8_t ledSkipNum = sizeof(ledSkipList) / sizeof(ledSkipList[0]);
+#ifdef CONFIG_ZBOARD_WIRING_RUNTIME
+
+// Map for a wiring set at runtime
+static uint16_t led_map_runtime[MAX_PIXELS];
+static uint16_t led_map_moon_runtime[MAX_PIXELS];
+static uint16_t led_map_moon_above_runtime[MAX_PIXELS];
+
+static wiring_config_t currentWiring;
+static bool bRuntimeWiring = false; // Are the led_map pointers using the runtime tables?
 
-#ifdef WIRING_FIRST_LED_RIGHT
-bool bWiringFirstLEDRight = true;
+static bool wiringIsDefault(const wiring_config_t *wiring)
+{
+#ifdef LED_MAP_GENERATED_CUSTOM
+	return false;
 #else
-bool bWiringFirstLEDRight = false;
+	return wiring->bFirstLEDRight == LED_MAP_GENERATED_FIRST_LED_RIGHT &&
+		   wiring->bFirstLEDBottom == LED_MAP_GENERATED_FIRST_LED_BOTTOM &&
+		   wiring->skipMask == LED_MAP_GENERATED_SKIP_MASK;
 #endif
+}
 
-#ifdef WIRING_FIRST_LED_BOTTOM
-bool bWiringFirstLEDBottom = true;
-#else
-bool bWiringFirstLEDBottom = false;
+// Builds the map for a zig-zag wiring. Must produce the same map as zigzag_map() in scripts/gen_led_map.py.
+static void buildMap(const wiring_config_t *wiring, int ledsInCol)
+{
+	for (int wiredCol = 0; wiredCol < NUM_COLS; wiredCol++)
+	{
+		int col = wiring->bFirstLEDRight ? (NUM_COLS - 1 - wiredCol) : wiredCol;
+		// The first column is wired down unless the first LED is at the bottom, and each column reverses direction
+		bool bGoesDown = ((wiredCol % 2) == 0) != wiring->bFirstLEDBottom;
+		int row = bGoesDown ? (NUM_ROWS - 1) : 0;
+		uint64_t skipMask = wiring->skipMask;
+		for (int pos = 0; pos < ledsInCol; pos++)
+		{
+			// Every other column is wired in the opposite direction, so the skipped positions are mirrored
+			int skipPos = (wiredCol % 2 == 0) ? pos : (ledsInCol - 1 - pos);
+			if (skipMask & (1ULL << skipPos))
+			{
+				continue;
+			}
+			led_map_runtime[col * NUM_ROWS + row] = wiredCol * ledsInCol + pos;
+			row += bGoesDown ? -1 : 1;
+		}
+	}
+
+	// The layout's numbering of the holds is generated with the build-time map
+	for (int hold = 0; hold < NUM_PIXELS; hold++)
+	{
+		int pos = led_layout->positions[hold];
+		led_map_moon_runtime[hold] = led_map_runtime[pos];
+		led_map_moon_above_runtime[hold] = (pos % NUM_ROWS == NUM_ROWS - 1) ? LED_MAP_NONE : led_map_runtime[pos + 1];
+	}
+}
+
+static void resetWiring(void)
+{
+#ifndef LED_MAP_GENERATED_CUSTOM
+	currentWiring.bFirstLEDRight = LED_MAP_GENERATED_FIRST_LED_RIGHT;
+	currentWiring.bFirstLEDBottom = LED_MAP_GENERATED_FIRST_LED_BOTTOM;
+	currentWiring.skipMask = LED_MAP_GENERATED_SKIP_MASK;
 #endif
+}
 
-bool ledSkip(uint16_t ledNum)
+void led_map_init(uint16_t numLEDs)
 {
-	if (sizeof(ledSkipList) == 0)
+	maxLEDs = numLEDs;
+	resetWiring();
+}
+
+// Switches to the map for the given wiring, or back to the build-time map if wiring is NULL
+int led_map_set_wiring(const wiring_config_t *wiring)
+{
+	if (!wiring || wiringIsDefault(wiring))
+	{
+		useLayoutMap();
+		bRuntimeWiring = false;
+		resetWiring();
+		LOG_INF("Using build-time wiring");
+		return 0;
+	}
+
+	int ledsInCol = NUM_ROWS + __builtin_popcountll(wiring->skipMask);
+	if (ledsInCol > WIRING_MAX_COLUMN_LEDS || (ledsInCol < WIRING_MAX_COLUMN_LEDS && (wiring->skipMask >> ledsInCol) != 0))
+	{
+		LOG_ERR("Invalid skip list 0x%llx", (unsigned long long)wiring->skipMask);
+		return -EINVAL;
+	}
+	if (ledsInCol * NUM_COLS > maxLEDs)
+	{
+		LOG_ERR("Wiring needs %d LEDs but the strip only has %d", ledsInCol * NUM_COLS, maxLEDs);
+		return -EINVAL;
+	}
+
+	buildMap(wiring, ledsInCol);
+	currentWiring = *wiring;
+	led_map = led_map_runtime;
+	led_map_moon = led_map_moon_runtime;
+	led_map_moon_above = led_map_moon_above_runtime;
+	bRuntimeWiring = true;
+	LOG_INF("Using wiring: first LED %s/%s, skip mask 0x%llx", wiring->bFirstLEDRight ? "right" : "left",
+			wiring->bFirstLEDBottom ? "bottom" : "top", (unsigned long long)wiring->skipMask);
+	return 0;
+}
+
+// Returns false if the current map is a custom map rather than a zig-zag wiring
+bool led_map_get_wiring(wiring_config_t *wiring)
+{
+#ifdef LED_MAP_GENERATED_CUSTOM
+	if (!bRuntimeWiring)
 	{
 		return false;
 	}
-	for (size_t i = 0; i < ledSkipNum; i++)
+#endif
+	*wiring = currentWiring;
+	return true;
+}
+
+#ifdef CONFIG_SETTINGS
+
+// Saves the current wiring, or removes the saved wiring if the build-time map is in use
+int led_map_save_wiring(void)
+{
+	if (!bRuntimeWiring)
+	{
+		return settings_delete(WIRING_SETTINGS_KEY);
+	}
+	return settings_save_one(WIRING_SETTINGS_KEY, &currentWiring, sizeof(currentWiring));
+}
+
+static int wiring_settings_set(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	if (!key || strcmp(key, "config") != 0)
 	{
-		if (ledNum == ledSkipList[i])
-		{
-			return true;
-		}
+		return -ENOENT;
+	}
+	wiring_config_t wiring;
+	if (len != sizeof(wiring))
+	{
+		return -EINVAL;
 	}
+	int rc = read_cb(cb_arg, &wiring, sizeof(wiring));
+	if (rc < 0)
+	{
+		return rc;
+	}
+	return led_map_set_wiring(&wiring);
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(wiring, "wiring", NULL, wiring_settings_set, NULL, NULL);
+
+#else
+
+int led_map_save_wiring(void)
+{
+	return -ENOTSUP;
+}
+
+#endif // CONFIG_SETTINGS
+
+#else
+
+void led_map_init(uint16_t numLEDs)
+{
+	maxLEDs = numLEDs;
+}
+
+int led_map_set_wiring(const wiring_config_t *wiring)
+{
+	return wiring ? -ENOTSUP : 0;
+}
+
+int led_map_save_wiring(void)
+{
+	return -ENOTSUP;
+}
+
+bool led_map_get_wiring(wiring_config_t *wiring)
+{
 	return false;
 }
 
-uint16_t moonNumToMapNum(uint16_t moonNum)
+#endif // CONFIG_ZBOARD_WIRING_RUNTIME
+
+#ifdef CONFIG_ZBOARD_LAYOUT_RUNTIME
+
+// Points the led_map pointers at the map of the layout in use, rebuilding it if a wiring was set at runtime
+static int remapLayout(void)
 {
-	int iFullCols = moonNum / NUM_ROWS;
-	int iLEDsRemaining = moonNum % NUM_ROWS;
-	// We get passed the number of the LED in the standard wiring, which has LED #0 at the bottom-left
-	// Our LED map has the columns in sequence, with every column numbered from bottom to top
-	// If the LED is in an even column (0-indexed), the numbers will be the same.
-	// If the LED is in an odd column (0-indexed), the numbers will be reversed since the wiring goes down the next column
-	if (iFullCols % 2 == 0)
+#ifdef CONFIG_ZBOARD_WIRING_RUNTIME
+	if (bRuntimeWiring)
 	{
-		return moonNum;
+		return led_map_set_wiring(&currentWiring);
 	}
-	else
+#endif
+	useLayoutMap();
+	return 0;
+}
+
+int led_map_set_layout(int index)
+{
+	if (index < 0 || index >= LED_MAP_NUM_LAYOUTS)
+	{
+		return -EINVAL;
+	}
+	const led_layout_t *layout = &led_layouts[index];
+	if (layout->maxLED >= maxLEDs)
+	{
+		LOG_ERR("Layout %s needs %d LEDs but the strip only has %d", layout->name, layout->maxLED + 1, maxLEDs);
+		return -EINVAL;
+	}
+
+	const led_layout_t *previous = led_layout;
+	led_layout = layout;
+	int rc = remapLayout();
+	if (rc)
 	{
-		return (iFullCols * NUM_ROWS) + (NUM_ROWS - 1 - iLEDsRemaining);
+		led_layout = previous;
+		return rc;
 	}
+	LOG_INF("Using layout %s (%d columns by %d rows)", layout->name, layout->cols, layout->rows);
+	return 0;
 }
 
-#ifndef WIRING_CUSTOM
-void initialize_led_map()
+#ifdef CONFIG_SETTINGS
+
+// Saves the layout in use by name, so the setting still means the same layout if the firmware is rebuilt
+// with another one selected in Kconfig. The build-time layout isn't saved.
+int led_map_save_layout(void)
 {
-	bool bWiringGoesDownThisCol = !bWiringFirstLEDBottom;
-	uint8_t ledsInCol = NUM_ROWS + ledSkipNum; // number of LEDs in each column including skipped LEDs
+	if (led_layout == &led_layouts[0])
+	{
+		return settings_delete(LAYOUT_SETTINGS_KEY);
+	}
+	return settings_save_one(LAYOUT_SETTINGS_KEY, led_layout->name, strlen(led_layout->name));
+}
 
-	uint16_t ledNum = 0;
-	int col = bWiringFirstLEDRight ? (NUM_COLS - 1) : 0;   // current column we are filling in the LED map
-	int row = bWiringGoesDownThisCol ? (NUM_ROWS - 1) : 0; // current row we are filling in the LED map
-	while (col < NUM_COLS && col >= 0)
+static int layout_settings_set(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	if (!key || strcmp(key, "name") != 0)
 	{
-		while (row < NUM_ROWS && row >= 0)
-		{
-			// Figure out where to save this LED number in the map
-			led_map[col * NUM_ROWS + row] = ledNum;
-			row += bWiringGoesDownThisCol ? -1 : 1;
-			// Move to the next LED in the chain, skipping any LEDs that need to be skipped
-			ledNum++;
-			uint8_t ledNumInChunk = ledNum % (2 * ledsInCol);
-			// The first clause is for columns 1,3,5, etc. , second clause is for columns 2,4,6, etc. since the wiring goes down one column and up the next
-			while ((ledNumInChunk < ledsInCol && ledSkip(ledNumInChunk)) || (ledNumInChunk > ledsInCol && ledSkip(2 * ledsInCol - 1 - ledNumInChunk)))
-			{
-				ledNum++;
-				ledNumInChunk = ledNum % (2 * ledsInCol);
-			}
-		}
-		col += bWiringFirstLEDRight ? -1 : 1;
-		if (row == NUM_ROWS)
-		{
-			row = NUM_ROWS - 1;
-		}
-		else if (row == -1)
+		return -ENOENT;
+	}
+	char name[LAYOUT_NAME_MAX];
+	if (len >= sizeof(name))
+	{
+		return -EINVAL;
+	}
+	int rc = read_cb(cb_arg, name, len);
+	if (rc < 0)
+	{
+		return rc;
+	}
+	name[rc] = '\0';
+	for (int i = 0; i < LED_MAP_NUM_LAYOUTS; i++)
+	{
+		if (strcmp(led_layouts[i].name, name) == 0)
 		{
-			row = 0;
+			return led_map_set_layout(i);
 		}
-		bWiringGoesDownThisCol = !bWiringGoesDownThisCol;
 	}
+	LOG_WRN("Saved layout %s is not built in", name);
+	return 0;
 }
+
+SETTINGS_STATIC_HANDLER_DEFINE(layout, "layout", NULL, layout_settings_set, NULL, NULL);
+
 #else
-void initialize_led_map()
+
+int led_map_save_layout(void)
 {
-	// If you want to define your own wiring configuration, you can do that here
-	// The led_map[x*numRows + y] array needs to contain the LED number that should be used for the
-	// hold at row x, column y. Rows are number L-to-R and columns are numbered from the bottom up.
+	return -ENOTSUP;
 }
-#endif
\ No newline at end of file
+
+#endif // CONFIG_SETTINGS
+
+#else
+
+int led_map_set_layout(int index)
+{
+	return index == 0 ? 0 : -ENOTSUP;
+}
+
+int led_map_save_layout(void)
+{
+	return -ENOTSUP;
+}
+
+#endif // CONFIG_ZBOARD_LAYOUT_RUNTIME
@@ -1,39 +1,69 @@
 #ifndef _LED_MAP_H
 #define _LED_MAP_H
 
-#include <zephyr/logging/log.h>
-
-// Wiring must be zig-zag fashion up and down the columns.
-// By default, we have the first LED at the top of the first column, and the columns go left to right
-// Uncommenting the following defines can modify this
-#define WIRING_FIRST_LED_RIGHT // Columns goes right to left instead
-// #define WIRING_FIRST_LED_BOTTOM			// First LED is at the bottom of the first column instead of the top
-
-// If some LEDs need to be skipped because there is a beam or other obstruction that you need to go around/over,
-// you can control that here. You need to specify the LED numbers that will be skipped in the first column and the code
-// will assume the other columns are identical.
-// For example, if you have a beam between the 6th and 7th row, and another between the 12th and 13th row, and you need
-// to skip 2 LEDs for each beam, you'd specify 6,7,14,15 so that LEDs 0-5, 8-13, 16-21 are used for the first column
-// #define WIRING_LEDS_SKIP_FIRST_COLUMN 6,7,14,15
-
-// If you want to define your own wiring configuration, you need to unccmment the following line and implement initialize_led_map()
-// in led_map.c
-// #define WIRING_CUSTOM
+// The wiring of the LEDs is configured with the CONFIG_ZBOARD_WIRING_* options (see Kconfig), and the map
+// for that wiring is generated at build time by scripts/gen_led_map.py into const tables that live in flash.
+// With CONFIG_ZBOARD_WIRING_RUNTIME, a different zig-zag wiring can be set at runtime and saved with the
+// settings subsystem. The map is then rebuilt into RAM and the led_map pointers switched over to it.
+//
+// The size of the board and how its holds are numbered come from the board layout selected with the
+// CONFIG_ZBOARD_LAYOUT_* options. With CONFIG_ZBOARD_LAYOUT_RUNTIME the tables for every built-in layout are
+// generated, and the layout can be switched at runtime. NUM_ROWS and NUM_COLS then follow the layout in use,
+// and MAX_PIXELS is the size of the largest one.
 
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-#define NUM_ROWS 18
-#define NUM_COLS 11
-#define NUM_PIXELS NUM_ROWS *NUM_COLS
+#include "led_map_generated.h"
+
+#ifdef CONFIG_ZBOARD_LAYOUT_RUNTIME
+#define NUM_ROWS (led_layout->rows)
+#define NUM_COLS (led_layout->cols)
+#else
+#define NUM_ROWS LED_MAP_GENERATED_ROWS
+#define NUM_COLS LED_MAP_GENERATED_COLS
+#endif
+#define NUM_PIXELS (NUM_ROWS * NUM_COLS)
+#define MAX_PIXELS LED_MAP_MAX_POSITIONS
+
+#define LED_MAP_NONE 0xFFFF	   // No LED, e.g. the position above a hold in the top row
+#define WIRING_MAX_COLUMN_LEDS 64 // Including skipped LEDs, so that the skip list fits in a 64-bit mask
 
 #define LED_MAP_COL_ROW(col, row) (led_map[(col) * NUM_ROWS + (row)])
 
-extern uint16_t led_map[NUM_PIXELS];
+typedef struct wiringConfig
+{
+	bool bFirstLEDRight;  // Columns go right to left
+	bool bFirstLEDBottom; // First LED is at the bottom of the first column
+	uint64_t skipMask;	  // Bit n is set if LED n of the first column is skipped (mirrored in every other column)
+} wiring_config_t;
+
+typedef struct ledLayout
+{
+	const char *name;
+	uint8_t rows;
+	uint8_t cols;
+	uint16_t maxLED;		   // Highest LED number of the build-time wiring
+	const uint16_t *map;	   // Build-time tables for the led_map pointers below
+	const uint16_t *holds;
+	const uint16_t *holdsAbove;
+	const uint16_t *positions; // Position (col * rows + row) of each hold number
+} led_layout_t;
+
+extern const led_layout_t led_layouts[LED_MAP_NUM_LAYOUTS]; // The layout selected at build time is first
+extern const led_layout_t *led_layout;						 // Layout in use
+
+extern const uint16_t *led_map;			   // LED number for each position, indexed by col * NUM_ROWS + row
+extern const uint16_t *led_map_moon;	   // LED number for each hold number of the layout
+extern const uint16_t *led_map_moon_above; // LED number of the position above each hold number
 
-bool ledSkip(uint16_t);
-void initialize_led_map();
-uint16_t moonNumToMapNum(uint16_t moonNum);
+void led_map_init(uint16_t numLEDs);
+int led_map_set_wiring(const wiring_config_t *wiring);
+int led_map_save_wiring(void);
+bool led_map_get_wiring(wiring_config_t *wiring);
+// Switches to one of led_layouts[]. Returns -EINVAL if it doesn't exist or needs more LEDs than the strip has.
+int led_map_set_layout(int index);
+int led_map_save_layout(void);
 
-#endif // _LED_MAP_H
\ No newline at end of file
+#endif // _LED_MAP_H
@@ -0,0 +1,342 @@
+#include "led_output.h"
+
+#include <string.h>
+
+#include "strip_power.h"
+#include "zboard.h"
+
+#ifdef CONFIG_ZBOARD_STRIP_I2S_DIRECT
+#include "led_output_i2s.h"
+#endif
+
+#define LOG_LEVEL LOG_LEVEL_INF
+LOG_MODULE_REGISTER(led_output);
+
+BUILD_ASSERT(STRIP_LENGTH < LED_MAP_NONE, "LED numbers must fit in 16 bits");
+
+typedef struct ledSegment
+{
+	const struct device *dev;
+	uint16_t first; // LED number of the segment's first LED
+	uint16_t length;
+} led_segment_t;
+
+#define SEGMENT(_alias, _first, _length) {.dev = DEVICE_DT_GET(DT_ALIAS(_alias)), .first = (_first), .length = (_length)}
+
+static const led_segment_t segments[NUM_STRIP_SEGMENTS] = {
+	SEGMENT(led_strip, 0, STRIP_SEGMENT_0_LENGTH),
+#if DT_HAS_ALIAS(led_strip_1)
+	SEGMENT(led_strip_1, STRIP_SEGMENT_0_LENGTH, STRIP_SEGMENT_1_LENGTH),
+#endif
+#if DT_HAS_ALIAS(led_strip_2)
+	SEGMENT(led_strip_2, STRIP_SEGMENT_0_LENGTH + STRIP_SEGMENT_1_LENGTH, STRIP_SEGMENT_2_LENGTH),
+#endif
+#if DT_HAS_ALIAS(led_strip_3)
+	SEGMENT(led_strip_3, STRIP_SEGMENT_0_LENGTH + STRIP_SEGMENT_1_LENGTH + STRIP_SEGMENT_2_LENGTH, STRIP_SEGMENT_3_LENGTH),
+#endif
+};
+
+led_output_stats_t led_output_stats;
+
+static led_frame_t framebuffers[2];
+led_frame_t *pixels = &framebuffers[0];
+static led_frame_t *front = &framebuffers[1]; // What the strip is currently showing
+static bool bFrontValid = false;			  // False until the first frame is sent, or after an error
+static K_MUTEX_DEFINE(backLock);			  // Held by the producer drawing into the back buffer
+
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+static struct led_rgb palette[LED_PALETTE_SIZE];
+static uint16_t paletteDirty = 0; // Bit per palette entry changed since the last frame was sent
+static struct k_work paletteWork;
+#endif
+
+#ifdef CONFIG_ZBOARD_RENDER_WORKQUEUE
+static K_THREAD_STACK_DEFINE(renderStack, CONFIG_ZBOARD_RENDER_WORKQUEUE_STACK_SIZE);
+static struct k_work_q renderWorkQ;
+#endif
+
+// With CONFIG_ZBOARD_STRIP_I2S_DIRECT the first segment is encoded straight into the I2S buffer
+#ifdef CONFIG_ZBOARD_STRIP_I2S_DIRECT
+#define SEND_BUFFER_FIRST STRIP_SEGMENT_0_LENGTH
+#else
+#define SEND_BUFFER_FIRST 0
+#endif
+#if STRIP_LENGTH > SEND_BUFFER_FIRST
+static struct led_rgb sendBuffer[STRIP_LENGTH - SEND_BUFFER_FIRST]; // led_strip drivers may overwrite the frame they're given
+#endif
+
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+static inline uint8_t pixelIndex(const led_frame_t *frame, int ledNum)
+{
+	return (frame->indices[ledNum >> 1] >> ((ledNum & 1) * 4)) & 0x0F;
+}
+
+static inline const struct led_rgb *pixelRGB(const led_frame_t *frame, int ledNum)
+{
+	return &palette[pixelIndex(frame, ledNum)];
+}
+
+// LEDs whose palette index or palette entry has changed since the front buffer was sent
+static inline bool pixelChanged(int ledNum)
+{
+	uint8_t index = pixelIndex(pixels, ledNum);
+	return index != pixelIndex(front, ledNum) || (paletteDirty & BIT(index));
+}
+
+static void loadDefaultPalette(void)
+{
+	memset(palette, 0, sizeof(palette));
+	for (int i = 0; i < NUM_COLORS; i++)
+	{
+		palette[i] = color_list[i].rgb;
+	}
+	paletteDirty = BIT_MASK(LED_PALETTE_SIZE);
+}
+
+// Re-sends the LEDs whose colour has changed
+static void showPalette(struct k_work *work)
+{
+	led_output_begin(false);
+	led_output_flip();
+}
+#else
+static inline const struct led_rgb *pixelRGB(const led_frame_t *frame, int ledNum)
+{
+	return &frame->rgb[ledNum];
+}
+
+static inline bool pixelChanged(int ledNum)
+{
+	const struct led_rgb *a = &pixels->rgb[ledNum];
+	const struct led_rgb *b = &front->rgb[ledNum];
+	return a->r != b->r || a->g != b->g || a->b != b->b;
+}
+#endif
+
+// Is every LED of the frame black, so that the strip could be switched off?
+static bool frameIsDark(const led_frame_t *frame)
+{
+	for (int i = 0; i < STRIP_LENGTH; i++)
+	{
+		const struct led_rgb *rgb = pixelRGB(frame, i);
+		if (rgb->r || rgb->g || rgb->b)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int led_output_init(void)
+{
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+	loadDefaultPalette();
+	k_work_init(&paletteWork, showPalette);
+	memset(framebuffers, LED_PALETTE_PAIR(COLOR_BLACK.index), sizeof(framebuffers));
+#endif
+#ifdef CONFIG_ZBOARD_RENDER_WORKQUEUE
+	const struct k_work_queue_config cfg = {.name = "zboard_render"};
+	k_work_queue_init(&renderWorkQ);
+	k_work_queue_start(&renderWorkQ, renderStack, K_THREAD_STACK_SIZEOF(renderStack),
+					   CONFIG_ZBOARD_RENDER_WORKQUEUE_PRIORITY, &cfg);
+#endif
+	for (int s = 1; s < NUM_STRIP_SEGMENTS; s++)
+	{
+		if (!device_is_ready(segments[s].dev))
+		{
+			LOG_ERR("LED strip device %s is not ready", segments[s].dev->name);
+			return -ENODEV;
+		}
+	}
+	int err = strip_power_init();
+	if (err)
+	{
+		return err;
+	}
+#ifdef CONFIG_ZBOARD_STRIP_I2S_DIRECT
+	return led_output_i2s_init();
+#else
+	return 0;
+#endif
+}
+
+int led_output_submit(struct k_work *work)
+{
+#ifdef CONFIG_ZBOARD_RENDER_WORKQUEUE
+	return k_work_submit_to_queue(&renderWorkQ, work);
+#else
+	return k_work_submit(work);
+#endif
+}
+
+led_frame_t *led_output_begin(bool bClear)
+{
+	k_mutex_lock(&backLock, K_FOREVER);
+	if (bClear)
+	{
+		led_output_clear();
+	}
+	else
+	{
+		*pixels = *front;
+	}
+	return pixels;
+}
+
+void led_output_clear(void)
+{
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+	memset(pixels, LED_PALETTE_PAIR(COLOR_BLACK.index), sizeof(*pixels));
+#else
+	memset(pixels, 0, sizeof(*pixels));
+#endif
+}
+
+void led_output_set(uint16_t ledNum, const color_t *color)
+{
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+	uint8_t *pair = &pixels->indices[ledNum >> 1];
+	*pair = (ledNum & 1) ? ((*pair & 0x0F) | (color->index << 4)) : ((*pair & 0xF0) | color->index);
+#else
+	pixels->rgb[ledNum] = color->rgb;
+#endif
+}
+
+// Sends the first numPixels LEDs of a segment of the front buffer
+static int sendSegment(int s, int numPixels)
+{
+#ifdef CONFIG_ZBOARD_STRIP_I2S_DIRECT
+	if (s == 0)
+	{
+		return led_output_i2s_send(numPixels); // Already encoded, and sent in the background while the others go out
+	}
+#endif
+#if STRIP_LENGTH > SEND_BUFFER_FIRST
+	const led_segment_t *segment = &segments[s];
+	struct led_rgb *send = &sendBuffer[segment->first - SEND_BUFFER_FIRST];
+	// The frame is only expanded to RGB here, as it is sent
+	for (int i = 0; i < numPixels; i++)
+	{
+		send[i] = *pixelRGB(front, segment->first + i);
+	}
+	return led_strip_update_rgb(segment->dev, send, numPixels);
+#else
+	return -EINVAL;
+#endif
+}
+
+// Sends the back buffer to the strip if it differs from the front buffer, then swaps them. Each segment
+// is only sent if it has changed, and with CONFIG_ZBOARD_STRIP_PARTIAL_UPDATE only up to its last change.
+// A dark frame isn't sent at all if the strip is switched off (see strip_power.h).
+int led_output_flip(void)
+{
+	bool bDark = frameIsDark(pixels);
+	if (!bDark && strip_power_up())
+	{
+		bFrontValid = false; // The LEDs lost what they were showing while the strip was off
+	}
+	bool bSend = !bDark || strip_power_is_on();
+
+	int lastChanged[NUM_STRIP_SEGMENTS]; // Relative to the start of each segment
+	for (int s = 0; s < NUM_STRIP_SEGMENTS; s++)
+	{
+		lastChanged[s] = -1;
+	}
+	int s = 0;
+	for (int i = 0; i < STRIP_LENGTH && bSend; i++)
+	{
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+		// Unchanged pairs of LEDs are skipped a byte at a time
+		if (bFrontValid && !paletteDirty && (i & 1) == 0 && pixels->indices[i >> 1] == front->indices[i >> 1])
+		{
+			i++;
+			continue;
+		}
+#endif
+		if (bFrontValid && !pixelChanged(i))
+		{
+			continue;
+		}
+		while (i >= segments[s].first + segments[s].length)
+		{
+			s++;
+		}
+#ifdef CONFIG_ZBOARD_STRIP_I2S_DIRECT
+		if (s == 0)
+		{
+			led_output_i2s_encode(i, pixelRGB(pixels, i));
+		}
+#endif
+		lastChanged[s] = i - segments[s].first;
+	}
+
+	// The swap is just the two pointers, so the old front buffer is free for the next frame at once
+	led_frame_t *tmp = front;
+	front = pixels;
+	pixels = tmp;
+
+	int err = 0;
+	int numSent = 0;
+	for (s = 0; s < NUM_STRIP_SEGMENTS && !err; s++)
+	{
+		if (lastChanged[s] < 0)
+		{
+			continue;
+		}
+		int numPixels = IS_ENABLED(CONFIG_ZBOARD_STRIP_PARTIAL_UPDATE) && bFrontValid ? (lastChanged[s] + 1) : segments[s].length;
+		err = sendSegment(s, numPixels);
+		numSent += numPixels;
+	}
+	if (numSent == 0)
+	{
+		led_output_stats.framesSkipped++;
+	}
+	else
+	{
+		bFrontValid = !err;
+		if (!err)
+		{
+			led_output_stats.framesSent++;
+			led_output_stats.pixelsSent += numSent;
+		}
+	}
+	strip_power_frame_shown(bDark);
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+	if (!err)
+	{
+		paletteDirty = 0;
+	}
+#endif
+	k_mutex_unlock(&backLock);
+	return err;
+}
+
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+int led_output_set_palette(uint8_t index, struct led_rgb rgb)
+{
+	if (index >= LED_PALETTE_SIZE)
+	{
+		return -EINVAL;
+	}
+	k_mutex_lock(&backLock, K_FOREVER);
+	palette[index] = rgb;
+	paletteDirty |= BIT(index);
+	k_mutex_unlock(&backLock);
+	led_output_submit(&paletteWork);
+	return 0;
+}
+
+void led_output_reset_palette(void)
+{
+	k_mutex_lock(&backLock, K_FOREVER);
+	loadDefaultPalette();
+	k_mutex_unlock(&backLock);
+	led_output_submit(&paletteWork);
+}
+#endif
+
+// Forces the next frame to be sent in full, e.g. if the strip may have lost its contents
+void led_output_invalidate(void)
+{
+	bFrontValid = false;
+}
@@ -0,0 +1,76 @@
+#ifndef _LED_OUTPUT_H
+#define _LED_OUTPUT_H
+
+// Pushes frames to the LED strip. Frames are drawn into the back buffer (pixels) between
+// led_output_begin() and led_output_flip(), which makes it the front buffer and sends it, so only
+// complete frames ever reach the strip, and only one producer can be drawing at a time. The front
+// buffer is what the strip is showing, so unchanged frames aren't sent at all, and with
+// CONFIG_ZBOARD_STRIP_PARTIAL_UPDATE only the LEDs up to the last one that changed are sent, since
+// WS2812 LEDs past the end of the data keep their colour.
+// With CONFIG_ZBOARD_STRIP_I2S_DIRECT, frames bypass the led_strip driver and go to led_output_i2s.c,
+// which only re-encodes the pixels that changed and sends them in the background.
+// A strip split into segments (see zboard.h) is sent a segment at a time, skipping segments that haven't
+// changed, and the I2S segment goes first so that its transfer overlaps the others.
+// Work that draws frames is submitted with led_output_submit(), which with CONFIG_ZBOARD_RENDER_WORKQUEUE
+// runs it on a dedicated workqueue, so rendering and parsing (on the system workqueue) can't hold each other up.
+// With CONFIG_ZBOARD_FRAMEBUFFER_PALETTE, frames hold a 4-bit palette index per LED instead of its colour,
+// and are only expanded to RGB as they are sent. Changing a palette entry re-sends the LEDs that use it.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/drivers/led_strip.h>
+#include <zephyr/kernel.h>
+
+#include "zboard.h" // STRIP_LENGTH and color_t
+
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+#define LED_PALETTE_SIZE 16
+#define LED_PALETTE_PAIR(index) ((uint8_t)(((index) << 4) | (index))) // Both LEDs of a byte in one colour
+
+// Two LEDs per byte: the even numbered LED in the low nibble
+typedef struct ledFrame
+{
+    uint8_t indices[DIV_ROUND_UP(STRIP_LENGTH, 2)];
+} led_frame_t;
+#else
+typedef struct ledFrame
+{
+    struct led_rgb rgb[STRIP_LENGTH];
+} led_frame_t;
+#endif
+
+typedef struct ledOutputStats
+{
+    uint32_t framesSent;    // frames pushed to the strip
+    uint32_t framesSkipped; // frames that matched the front buffer
+    uint32_t pixelsSent;    // total pixels pushed to the strip
+} led_output_stats_t;
+
+extern led_output_stats_t led_output_stats;
+
+// The back buffer. Only valid between led_output_begin() and led_output_flip().
+extern led_frame_t *pixels;
+
+int led_output_init(void);
+// Queues work that draws frames on the render workqueue
+int led_output_submit(struct k_work *work);
+// Waits for any other producer to flip, then returns the back buffer, either cleared or as a copy of
+// the front buffer for producers that only change part of the frame
+led_frame_t *led_output_begin(bool bClear);
+// Sets an LED of the back buffer
+void led_output_set(uint16_t ledNum, const color_t *color);
+// Blanks the back buffer
+void led_output_clear(void);
+// Swaps the back and front buffers and sends the new front buffer to the strip
+int led_output_flip(void);
+void led_output_invalidate(void);
+
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+// Changes the colour that LEDs drawn with color_list[index] are shown in, and re-sends those LEDs
+int led_output_set_palette(uint8_t index, struct led_rgb rgb);
+// Goes back to the colours of color_list[]
+void led_output_reset_palette(void);
+#endif
+
+#endif // _LED_OUTPUT_H
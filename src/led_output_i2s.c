@@ -0,0 +1,153 @@
+#include "led_output_i2s.h"
+
+#include <string.h>
+
+#include <zephyr/drivers/i2s.h>
+#include <zephyr/dt-bindings/led/led.h>
+
+#include "zboard.h"
+
+#define LOG_LEVEL LOG_LEVEL_INF
+LOG_MODULE_REGISTER(led_output_i2s);
+
+// Drives the WS2812 strip (the first segment, if there are several) on the I2S peripheral that the worldsemi,ws2812-i2s node sits on, using the same
+// encoding as Zephyr's driver: each colour byte becomes one 32-bit I2S word, with a 4-bit symbol per bit.
+// Unlike the driver, the encoded frame is kept between updates, so only the pixels that changed are
+// re-encoded and the rest is a copy into the DMA block. The transfer runs in the background; the next
+// update only waits if it comes in before the previous transfer has finished.
+
+#define STRIP_NODE DT_ALIAS(led_strip)
+#define I2S_NODE DT_BUS(STRIP_NODE)
+
+#define WS2812_PRE_DELAY_WORDS 1 // so the first pixel isn't skipped by the strip
+#define WS2812_NUM_COLORS DT_PROP_LEN(STRIP_NODE, color_mapping)
+#define WS2812_LRCK_PERIOD_US DT_PROP(STRIP_NODE, lrck_period) // Time to send one word, i.e. 8 bits
+#define WS2812_RESET_WORDS DIV_ROUND_UP(DT_PROP(STRIP_NODE, reset_delay), WS2812_LRCK_PERIOD_US)
+#define WS2812_DATA_WORDS (WS2812_NUM_COLORS * STRIP_SEGMENT_0_LENGTH)
+#define WS2812_BUF_WORDS (WS2812_PRE_DELAY_WORDS + WS2812_DATA_WORDS + WS2812_RESET_WORDS)
+#define WS2812_RESET_WORD (DT_PROP(STRIP_NODE, out_active_low) ? 0xFFFFFFFF : 0x00000000)
+
+static const struct device *const i2s_dev = DEVICE_DT_GET(I2S_NODE);
+static const uint8_t color_mapping[] = DT_PROP(STRIP_NODE, color_mapping);
+
+K_MEM_SLAB_DEFINE_STATIC(ws2812_i2s_slab, WS2812_BUF_WORDS * sizeof(uint32_t), 1, 4);
+
+static uint32_t encodedByte[256];			   // I2S word for each colour value
+static uint32_t encoded[WS2812_DATA_WORDS]; // Encoded committed frame
+static int64_t transferDoneAt = 0;		   // Uptime in ticks when the last transfer will have finished
+
+int led_output_i2s_init(void)
+{
+	if (!device_is_ready(i2s_dev))
+	{
+		LOG_ERR("I2S device %s is not ready", i2s_dev->name);
+		return -ENODEV;
+	}
+
+	const uint8_t symOne = DT_PROP(STRIP_NODE, nibble_one);
+	const uint8_t symZero = DT_PROP(STRIP_NODE, nibble_zero);
+	for (int value = 0; value < 256; value++)
+	{
+		uint32_t word = 0;
+		for (int bit = 0; bit < 8; bit++)
+		{
+			word |= (uint32_t)((value & (1 << bit)) ? symOne : symZero) << (bit * 4);
+		}
+		// Swap the two 16-bit halves due to the (audio) channel TX order
+		word = (word >> 16) | (word << 16);
+		encodedByte[value] = DT_PROP(STRIP_NODE, out_active_low) ? ~word : word;
+	}
+	for (int i = 0; i < STRIP_SEGMENT_0_LENGTH; i++)
+	{
+		led_output_i2s_encode(i, &COLOR_BLACK.rgb);
+	}
+
+	struct i2s_config config = {
+		.word_size = 16,
+		.channels = 2,
+		.format = I2S_FMT_DATA_FORMAT_I2S,
+		.options = I2S_OPT_BIT_CLK_MASTER | I2S_OPT_FRAME_CLK_MASTER,
+		.frame_clk_freq = 1000000 / WS2812_LRCK_PERIOD_US,
+		.mem_slab = &ws2812_i2s_slab,
+		.block_size = WS2812_BUF_WORDS * sizeof(uint32_t),
+		.timeout = 1000,
+	};
+	int err = i2s_configure(i2s_dev, I2S_DIR_TX, &config);
+	if (err)
+	{
+		LOG_ERR("Failed to configure I2S: %d", err);
+	}
+	return err;
+}
+
+void led_output_i2s_encode(int ledNum, const struct led_rgb *rgb)
+{
+	uint32_t *word = &encoded[ledNum * WS2812_NUM_COLORS];
+	for (int i = 0; i < WS2812_NUM_COLORS; i++)
+	{
+		switch (color_mapping[i])
+		{
+		case LED_COLOR_ID_RED:
+			word[i] = encodedByte[rgb->r];
+			break;
+		case LED_COLOR_ID_GREEN:
+			word[i] = encodedByte[rgb->g];
+			break;
+		case LED_COLOR_ID_BLUE:
+			word[i] = encodedByte[rgb->b];
+			break;
+		default: // e.g. the white channel of RGBW LEDs
+			word[i] = encodedByte[0];
+			break;
+		}
+	}
+}
+
+// Sends the first numPixels pixels of the encoded frame
+int led_output_i2s_send(int numPixels)
+{
+	// Only one transfer can be in progress. This is usually a no-op since frames are far enough apart.
+	k_sleep(K_TIMEOUT_ABS_TICKS(transferDoneAt));
+
+	void *block;
+	int err = k_mem_slab_alloc(&ws2812_i2s_slab, &block, K_MSEC(100));
+	if (err)
+	{
+		LOG_ERR("Unable to allocate I2S buffer: %d", err);
+		return err;
+	}
+
+	uint32_t *tx = block;
+	int dataWords = numPixels * WS2812_NUM_COLORS;
+	for (int i = 0; i < WS2812_PRE_DELAY_WORDS; i++)
+	{
+		*tx++ = WS2812_RESET_WORD;
+	}
+	memcpy(tx, encoded, dataWords * sizeof(uint32_t));
+	tx += dataWords;
+	for (int i = 0; i < WS2812_RESET_WORDS; i++)
+	{
+		*tx++ = WS2812_RESET_WORD;
+	}
+
+	size_t numWords = tx - (uint32_t *)block;
+	err = i2s_write(i2s_dev, block, numWords * sizeof(uint32_t));
+	if (err)
+	{
+		k_mem_slab_free(&ws2812_i2s_slab, block);
+		return err;
+	}
+	err = i2s_trigger(i2s_dev, I2S_DIR_TX, I2S_TRIGGER_START);
+	if (!err)
+	{
+		err = i2s_trigger(i2s_dev, I2S_DIR_TX, I2S_TRIGGER_DRAIN);
+	}
+	if (err)
+	{
+		i2s_trigger(i2s_dev, I2S_DIR_TX, I2S_TRIGGER_DROP);
+		return err;
+	}
+	transferDoneAt = k_uptime_ticks() + k_us_to_ticks_ceil64(numWords * WS2812_LRCK_PERIOD_US +
+															  DT_PROP(STRIP_NODE, extra_wait_time));
+	return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef _LED_OUTPUT_I2S_H
+#define _LED_OUTPUT_I2S_H
+
+// Direct I2S backend for led_output.c (CONFIG_ZBOARD_STRIP_I2S_DIRECT)
+
+#include <zephyr/drivers/led_strip.h>
+
+int led_output_i2s_init(void);
+void led_output_i2s_encode(int ledNum, const struct led_rgb *rgb);
+int led_output_i2s_send(int numPixels);
+
+#endif // _LED_OUTPUT_I2S_H
@@ -1,133 +1,227 @@
 #include "led_patterns.h"
 
+#include "compositor.h"
+#include "trace.h"
+
 #define LOG_LEVEL LOG_LEVEL_INF
 LOG_MODULE_REGISTER(led_patterns);
 
-led_pattern_fn_t led_patterns[] = {
-    left_to_right_pattern,
-    right_to_left_pattern,
-    top_to_bottom_pattern,
-    bottom_to_top_pattern,
-    twinkle_pattern,
-};
-
-#define NUM_LED_PATTERNS (sizeof(led_patterns) / sizeof(led_patterns[0]))
+static void startupFrame(int c) // flash all LEDs in sequence to show we're alive and have Bluetooth working
+{
+    for (int r = 0; r < NUM_ROWS; r++)
+    {
+        LED_SET_ROW(r, color_list[(r + c) % 8]);
+    }
+}
 
-void led_startup_pattern(void)
+static void leftToRightFrame(int c)
 {
-    for (int c = 0; c < 40; c++) // flash all LEDs in sequence to show we're alive and have Bluetooth working
+    compositor_clear(LAYER_ANIMATION);
+    for (int r = 0; r < NUM_ROWS; r++)
     {
-        for (int r = 0; r < NUM_ROWS; r++)
-        {
-            LED_SET_ROW(r, color_list[(r + c) % 8]);
-        }
-        int err = led_strip_update_rgb(strip, pixels, STRIP_LENGTH);
-        if (err)
-        {
-            LOG_ERR("Failed to update LED strip: %d", err);
-            return;
-        }
-        k_sleep(K_MSEC(PATTERN_STEP_DELAY_MS));
+        LED_SET_PIXEL(c, r, color_list[r % NUM_COLORS]);
     }
 }
 
-void left_to_right_pattern(void)
+static void rightToLeftFrame(int frame)
+{
+    leftToRightFrame(NUM_COLS - 1 - frame);
+}
+
+static void bottomToTopFrame(int r)
 {
+    compositor_clear(LAYER_ANIMATION);
     for (int c = 0; c < NUM_COLS; c++)
     {
-        clearStrip(false);
-        for (int r = 0; r < NUM_ROWS; r++)
-        {
-            LED_SET_PIXEL(c, r, color_list[r % NUM_COLORS]);
-        }
-        int err = led_strip_update_rgb(strip, pixels, STRIP_LENGTH);
-        if (err)
-        {
-            LOG_ERR("Failed to update LED strip: %d", err);
-            return;
-        }
-        k_sleep(K_MSEC(PATTERN_STEP_DELAY_MS));
+        LED_SET_PIXEL(c, r, color_list[c % NUM_COLORS]);
     }
 }
 
-void right_to_left_pattern(void)
+static void topToBottomFrame(int frame)
+{
+    bottomToTopFrame(NUM_ROWS - 1 - frame);
+}
+
+static void twinkleFrame(int frame)
+{
+    int c = rand() % NUM_COLS;
+    int r = rand() % NUM_ROWS;
+    compositor_clear(LAYER_ANIMATION);
+    LED_SET_PIXEL(c, r, color_list[(c + r) % NUM_COLORS]);
+}
+
+const led_pattern_t led_startup_pattern = {"startup", 40, startupFrame};
+const led_pattern_t left_to_right_pattern = {"left to right", PATTERN_FRAMES_COLS, leftToRightFrame};
+const led_pattern_t right_to_left_pattern = {"right to left", PATTERN_FRAMES_COLS, rightToLeftFrame};
+const led_pattern_t top_to_bottom_pattern = {"top to bottom", PATTERN_FRAMES_ROWS, topToBottomFrame};
+const led_pattern_t bottom_to_top_pattern = {"bottom to top", PATTERN_FRAMES_ROWS, bottomToTopFrame};
+const led_pattern_t twinkle_pattern = {"twinkle", 20, twinkleFrame};
+
+static const led_pattern_t *const led_patterns[] = {
+    &left_to_right_pattern,
+    &right_to_left_pattern,
+    &top_to_bottom_pattern,
+    &bottom_to_top_pattern,
+    &twinkle_pattern,
+};
+
+#define NUM_LED_PATTERNS (sizeof(led_patterns) / sizeof(led_patterns[0]))
+
+led_pattern_stats_t led_pattern_stats;
+
+static struct k_timer patternTimer;
+static struct k_work patternFrameWork;
+static struct k_work patternClearWork;
+static struct k_spinlock patternLock;             // Protects activePattern, patternFrame and patternStart
+static const led_pattern_t *activePattern = NULL; // NULL if no pattern is running
+static int patternFrame = 0;                      // Next frame of the active pattern
+static int64_t patternStart;                      // k_uptime_ticks() when the active pattern started
+
+// Frames are due at fixed times from the start of the pattern, rather than a period after the last one was
+// sent, so the time taken to draw and send them doesn't add up over the pattern
+static int64_t frameDeadline(int64_t start, int frame)
+{
+    return start + k_us_to_ticks_ceil64((int64_t)frame * USEC_PER_SEC / CONFIG_ZBOARD_PATTERN_FPS);
+}
+
+static int patternFrames(const led_pattern_t *pattern)
 {
-    for (int c = NUM_COLS - 1; c >= 0; c--)
+    switch (pattern->numFrames)
     {
-        clearStrip(false);
-        for (int r = 0; r < NUM_ROWS; r++)
-        {
-            LED_SET_PIXEL(c, r, color_list[r % NUM_COLORS]);
-        }
-        int err = led_strip_update_rgb(strip, pixels, STRIP_LENGTH);
-        if (err)
-        {
-            LOG_ERR("Failed to update LED strip: %d", err);
-            return;
-        }
-        k_sleep(K_MSEC(PATTERN_STEP_DELAY_MS));
+    case PATTERN_FRAMES_COLS:
+        return NUM_COLS;
+    case PATTERN_FRAMES_ROWS:
+        return NUM_ROWS;
+    default:
+        return pattern->numFrames;
     }
 }
 
-void top_to_bottom_pattern(void)
+static void patternTimerExpired(struct k_timer *timer)
 {
-    for (int r = NUM_ROWS - 1; r >= 0; r--)
+    led_output_submit(&patternFrameWork);
+}
+
+// Stops the active pattern, returning whether one was running. The caller clears the animation layer.
+static bool stopPattern(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&patternLock);
+    bool bWasRunning = activePattern != NULL;
+    activePattern = NULL;
+    k_spin_unlock(&patternLock, key);
+    if (bWasRunning)
     {
-        clearStrip(false);
-        for (int c = 0; c < NUM_COLS; c++)
-        {
-            LED_SET_PIXEL(c, r, color_list[c % NUM_COLORS]);
-        }
-        int err = led_strip_update_rgb(strip, pixels, STRIP_LENGTH);
-        if (err)
-        {
-            LOG_ERR("Failed to update LED strip: %d", err);
-            return;
-        }
-        k_sleep(K_MSEC(PATTERN_STEP_DELAY_MS));
+        k_timer_stop(&patternTimer);
     }
+    return bWasRunning;
 }
 
-void bottom_to_top_pattern(void)
+// Clears the animation layer after a cancel. Runs on the render workqueue, so a parser thread never waits
+// for the compositor while a frame is being sent, and shows on the next commit, which is normally the
+// problem the pattern was cancelled for.
+static void clearPattern(struct k_work *work)
 {
-    for (int r = 0; r < NUM_ROWS; r++)
+    compositor_begin();
+    if (!led_pattern_running()) // Unless another pattern has been started since
     {
-        clearStrip(false);
-        for (int c = 0; c < NUM_COLS; c++)
-        {
-            LED_SET_PIXEL(c, r, color_list[c % NUM_COLORS]);
-        }
-        int err = led_strip_update_rgb(strip, pixels, STRIP_LENGTH);
-        if (err)
-        {
-            LOG_ERR("Failed to update LED strip: %d", err);
-            return;
-        }
-        k_sleep(K_MSEC(PATTERN_STEP_DELAY_MS));
+        compositor_clear(LAYER_ANIMATION);
     }
+    compositor_end();
 }
 
-void twinkle_pattern(void)
+// Shows the frame of the active pattern that is due on the animation layer, behind any problem that is
+// showing, and sets the timer for the next one. Runs on the render workqueue.
+static void showPatternFrame(struct k_work *work)
 {
-    for (int i = 0; i < 20; i++)
+    compositor_begin();
+    k_spinlock_key_t key = k_spin_lock(&patternLock);
+    const led_pattern_t *pattern = activePattern;
+    int frame = patternFrame;
+    int64_t start = patternStart;
+#ifdef CONFIG_ZBOARD_PATTERN_FRAME_SKIP
+    if (pattern)
     {
-        int c = rand() % NUM_COLS;
-        int r = rand() % NUM_ROWS;
-        clearStrip(false);
-        LED_SET_PIXEL(c, r, color_list[(c + r) % NUM_COLORS]);
-        int err = led_strip_update_rgb(strip, pixels, STRIP_LENGTH);
-        if (err)
+        // Skip any frames that are already past, so the pattern takes the same time however long frames take
+        int64_t elapsedUs = k_ticks_to_us_floor64(k_uptime_ticks() - start);
+        int due = MIN(elapsedUs * CONFIG_ZBOARD_PATTERN_FPS / USEC_PER_SEC, patternFrames(pattern));
+        if (due > frame)
         {
-            LOG_ERR("Failed to update LED strip: %d", err);
-            return;
+            led_pattern_stats.framesDropped += due - frame;
+            frame = due;
         }
-        k_sleep(K_MSEC(PATTERN_STEP_DELAY_MS));
+    }
+#endif
+    patternFrame = frame + 1;
+    k_spin_unlock(&patternLock, key);
+    if (!pattern) // Cancelled since the timer fired
+    {
+        compositor_end();
+        return;
+    }
+
+    if (frame >= patternFrames(pattern))
+    {
+        stopPattern();
+        compositor_clear(LAYER_ANIMATION);
+        compositor_commit();
+        return;
+    }
+    TRACE_EVENT(TRACE_PATTERN_FRAME, frame, 0);
+    pattern->next_frame(frame);
+    int err = compositor_commit();
+    if (err)
+    {
+        LOG_ERR("Failed to update LED strip: %d", err);
+        led_pattern_cancel();
+        return;
+    }
+
+    int64_t nextDeadline = frameDeadline(start, frame + 1);
+    led_pattern_stats.framesShown++;
+    if (k_uptime_ticks() > nextDeadline) // Still sending when the next frame was due
+    {
+        led_pattern_stats.framesLate++;
+    }
+    key = k_spin_lock(&patternLock);
+    if (activePattern == pattern && patternStart == start) // Not cancelled or restarted while drawing
+    {
+        k_timer_start(&patternTimer, K_TIMEOUT_ABS_TICKS(nextDeadline), K_NO_WAIT);
+    }
+    k_spin_unlock(&patternLock, key);
+}
+
+void led_patterns_init(void)
+{
+    k_timer_init(&patternTimer, patternTimerExpired, NULL);
+    k_work_init(&patternFrameWork, showPatternFrame);
+    k_work_init(&patternClearWork, clearPattern);
+}
+
+void led_pattern_start(const led_pattern_t *pattern)
+{
+    LOG_INF("Starting %s pattern", pattern->name);
+    k_spinlock_key_t key = k_spin_lock(&patternLock);
+    activePattern = pattern;
+    patternFrame = 0;
+    patternStart = k_uptime_ticks();
+    k_spin_unlock(&patternLock, key);
+    led_output_submit(&patternFrameWork); // The first frame goes out straight away and sets the timer for the next
+}
+
+void led_pattern_start_random(void)
+{
+    led_pattern_start(led_patterns[rand() % NUM_LED_PATTERNS]);
+}
+
+void led_pattern_cancel(void)
+{
+    if (stopPattern())
+    {
+        led_output_submit(&patternClearWork);
     }
 }
 
-void show_random_pattern(struct k_work *work)
+bool led_pattern_running(void)
 {
-    int pattern_index = rand() % NUM_LED_PATTERNS;
-    led_patterns[pattern_index]();
-    clearStrip(true);
-}
\ No newline at end of file
+    return activePattern != NULL;
+}
@@ -2,15 +2,43 @@
 
 #include <stdlib.h>
 
-#define PATTERN_STEP_DELAY_MS 50
+// Patterns are frame generators: next_frame() draws frame number <frame> on the compositor's animation
+// layer, which still holds the last frame, and a k_timer paces the frames so that nothing blocks while a
+// pattern runs. Frame <n> is due n / CONFIG_ZBOARD_PATTERN_FPS seconds after the pattern started, so a
+// pattern takes the same time on any length of strip. With CONFIG_ZBOARD_PATTERN_FRAME_SKIP, frames that
+// are already past when the previous one has been sent are dropped. Starting a pattern replaces the one
+// that is running, and led_pattern_cancel() stops it straight away, e.g. when a problem arrives.
+typedef struct ledPatternStats
+{
+    uint32_t framesShown;
+    uint32_t framesLate;    // frames still being sent when the next one was due
+    uint32_t framesDropped; // frames skipped to catch up
+} led_pattern_stats_t;
 
-typedef void (*led_pattern_fn_t)(void);
+extern led_pattern_stats_t led_pattern_stats;
 
-void led_startup_pattern(void);
-void left_to_right_pattern(void);
-void right_to_left_pattern(void);
-void top_to_bottom_pattern(void);
-void bottom_to_top_pattern(void);
-void twinkle_pattern(void);
+// numFrames of patterns with a frame per column or row, which depend on the board layout in use
+#define PATTERN_FRAMES_COLS (-1)
+#define PATTERN_FRAMES_ROWS (-2)
 
-void show_random_pattern(struct k_work *work);
+typedef struct ledPattern
+{
+    const char *name;
+    int numFrames; // or PATTERN_FRAMES_COLS / PATTERN_FRAMES_ROWS
+    void (*next_frame)(int frame);
+} led_pattern_t;
+
+extern const led_pattern_t led_startup_pattern;
+extern const led_pattern_t left_to_right_pattern;
+extern const led_pattern_t right_to_left_pattern;
+extern const led_pattern_t top_to_bottom_pattern;
+extern const led_pattern_t bottom_to_top_pattern;
+extern const led_pattern_t twinkle_pattern;
+
+void led_patterns_init(void);
+// The animation layer is cleared when the pattern ends or is cancelled
+void led_pattern_start(const led_pattern_t *pattern);
+void led_pattern_start_random(void);
+// Safe to call from any thread: the layer is cleared on the render workqueue, ahead of work submitted after
+void led_pattern_cancel(void);
+bool led_pattern_running(void);
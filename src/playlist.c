@@ -0,0 +1,179 @@
+#include "playlist.h"
+
+#include <string.h>
+
+#include "trace.h"
+
+#define LOG_LEVEL LOG_LEVEL_INF
+LOG_MODULE_REGISTER(playlist);
+
+#define NUM_SLOTS 3 // The entry showing and the ones either side
+
+typedef struct playlistSlot
+{
+	int entry; // -1 if the slot is empty
+	problem_frame_t frame;
+} playlist_slot_t;
+
+playlist_stats_t playlist_stats;
+
+static problem_t entries[CONFIG_ZBOARD_PLAYLIST_ENTRIES];
+static int numEntries = 0;
+static int current = 0; // Entry showing, or about to be shown by showWork
+static playlist_slot_t slots[NUM_SLOTS];
+static K_MUTEX_DEFINE(playlistLock); // Protects all of the above, since uploads and steps come from the parser
+static playlist_compose_t composeProblem;
+static struct k_work showWork;
+
+static int wrap(int entry)
+{
+	return ((entry % numEntries) + numEntries) % numEntries;
+}
+
+static bool isWanted(int entry)
+{
+	return entry == current || entry == wrap(current + 1) || entry == wrap(current - 1);
+}
+
+static playlist_slot_t *findSlot(int entry)
+{
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		if (slots[i].entry == entry)
+		{
+			return &slots[i];
+		}
+	}
+	return NULL;
+}
+
+// Composes the entry into a slot that doesn't hold the entry showing or either of its neighbours
+static playlist_slot_t *composeSlot(int entry)
+{
+	playlist_slot_t *slot = &slots[0];
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		if (slots[i].entry < 0 || !isWanted(slots[i].entry))
+		{
+			slot = &slots[i];
+			break;
+		}
+	}
+	slot->entry = entry;
+	composeProblem(&entries[entry], &slot->frame);
+	return slot;
+}
+
+// Shows the current entry and then composes its neighbours, ready for the next step. Runs on the render workqueue.
+// The frame is shown from a copy, so uploads and steps from the parser don't wait for the strip.
+static void showCurrent(struct k_work *work)
+{
+	static problem_frame_t showing; // Only used on the render workqueue
+	k_mutex_lock(&playlistLock, K_FOREVER);
+	if (numEntries == 0)
+	{
+		k_mutex_unlock(&playlistLock);
+		return;
+	}
+	playlist_slot_t *slot = findSlot(current);
+	TRACE_EVENT(TRACE_PLAYLIST_SHOW, current, slot != NULL);
+	if (slot)
+	{
+		playlist_stats.prefetchHits++;
+	}
+	else
+	{
+		playlist_stats.prefetchMisses++;
+		slot = composeSlot(current);
+	}
+	showing = slot->frame;
+	k_mutex_unlock(&playlistLock);
+
+	int err = compositor_show_problem(&showing);
+	if (err)
+	{
+		LOG_ERR("Failed to update LED strip: %d", err);
+	}
+
+	k_mutex_lock(&playlistLock, K_FOREVER);
+	if (numEntries > 0) // Unless the playlist was cleared meanwhile
+	{
+		int neighbours[] = {wrap(current + 1), wrap(current - 1)};
+		for (int i = 0; i < ARRAY_SIZE(neighbours); i++)
+		{
+			if (!findSlot(neighbours[i]))
+			{
+				composeSlot(neighbours[i]);
+			}
+		}
+	}
+	k_mutex_unlock(&playlistLock);
+}
+
+void playlist_init(playlist_compose_t compose)
+{
+	composeProblem = compose;
+	k_work_init(&showWork, showCurrent);
+	playlist_invalidate();
+}
+
+void playlist_clear(void)
+{
+	k_mutex_lock(&playlistLock, K_FOREVER);
+	numEntries = 0;
+	current = 0;
+	k_mutex_unlock(&playlistLock);
+	playlist_invalidate();
+}
+
+int playlist_add(const problem_t *prob)
+{
+	k_mutex_lock(&playlistLock, K_FOREVER);
+	int rc = -ENOSPC;
+	if (numEntries < CONFIG_ZBOARD_PLAYLIST_ENTRIES)
+	{
+		entries[numEntries++] = *prob;
+		rc = numEntries;
+	}
+	k_mutex_unlock(&playlistLock);
+	return rc;
+}
+
+int playlist_count(void)
+{
+	return numEntries;
+}
+
+static int showEntry(int entry, bool bRelative)
+{
+	k_mutex_lock(&playlistLock, K_FOREVER);
+	if (numEntries == 0)
+	{
+		k_mutex_unlock(&playlistLock);
+		return -ENOENT;
+	}
+	current = wrap(bRelative ? current + entry : entry);
+	k_mutex_unlock(&playlistLock);
+	led_output_submit(&showWork);
+	return 0;
+}
+
+int playlist_show(int entry)
+{
+	return showEntry(entry, false);
+}
+
+int playlist_step(int delta)
+{
+	return showEntry(delta, true);
+}
+
+void playlist_invalidate(void)
+{
+	k_mutex_lock(&playlistLock, K_FOREVER);
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		slots[i].entry = -1;
+	}
+	k_mutex_unlock(&playlistLock);
+}
@@ -0,0 +1,38 @@
+#ifndef _PLAYLIST_H
+#define _PLAYLIST_H
+
+// Playlist of problems for a training session (CONFIG_ZBOARD_PLAYLIST), uploaded in one batch with
+// 'u<count>#' followed by the problems, and then stepped through with the one byte '>' and '<' commands.
+// Problems are parsed once, as they are uploaded, and the frames of the entries either side of the one
+// showing are composed in the background, so a step only has to load a frame into the compositor.
+// The playlist wraps around at both ends.
+
+#include <stdint.h>
+
+#include "compositor.h"
+#include "zboard.h"
+
+// Draws a problem into a frame, as renderProblem() does
+typedef int (*playlist_compose_t)(const problem_t *prob, problem_frame_t *frame);
+
+typedef struct playlistStats
+{
+    uint32_t prefetchHits;   // steps to an entry that was already composed
+    uint32_t prefetchMisses; // steps that had to compose the entry first
+} playlist_stats_t;
+
+extern playlist_stats_t playlist_stats;
+
+void playlist_init(playlist_compose_t compose);
+// Empties the playlist for a new upload
+void playlist_clear(void);
+// Copies the problem to the end of the playlist. Returns the number of entries or -ENOSPC.
+int playlist_add(const problem_t *prob);
+int playlist_count(void);
+// Shows an entry, or moves by delta entries from the one showing. Returns -ENOENT if the playlist is empty.
+int playlist_show(int entry);
+int playlist_step(int delta);
+// Drops the composed frames, e.g. after the LED map changes
+void playlist_invalidate(void);
+
+#endif // _PLAYLIST_H
@@ -0,0 +1,79 @@
+#include "problem_cache.h"
+
+#include <string.h>
+
+typedef struct problemCacheEntry
+{
+	problem_t prob;
+	uint32_t hash;
+	uint32_t lastUsed; // 0 if the entry is empty
+	problem_frame_t frame;
+} problem_cache_entry_t;
+
+problem_cache_stats_t problem_cache_stats;
+
+static problem_cache_entry_t entries[CONFIG_ZBOARD_PROBLEM_CACHE_ENTRIES];
+static uint32_t useCounter = 0;
+
+// FNV-1a over the flags and the hold list
+uint32_t problem_cache_hash(const problem_t *prob)
+{
+	uint32_t hash = 2166136261u;
+	hash = (hash ^ (prob->bApplyLEDMapping | (prob->bAdditionalLEDs << 1))) * 16777619u;
+	for (int i = 0; i < prob->numHolds; i++)
+	{
+		hash = (hash ^ (prob->holds[i] & 0xFF)) * 16777619u;
+		hash = (hash ^ (prob->holds[i] >> 8)) * 16777619u;
+	}
+	return hash;
+}
+
+static bool problemsEqual(const problem_t *a, const problem_t *b)
+{
+	return a->numHolds == b->numHolds && a->bApplyLEDMapping == b->bApplyLEDMapping &&
+		   a->bAdditionalLEDs == b->bAdditionalLEDs && memcmp(a->holds, b->holds, a->numHolds * sizeof(a->holds[0])) == 0;
+}
+
+const problem_frame_t *problem_cache_lookup(const problem_t *prob, uint32_t hash)
+{
+	for (int i = 0; i < CONFIG_ZBOARD_PROBLEM_CACHE_ENTRIES; i++)
+	{
+		problem_cache_entry_t *entry = &entries[i];
+		if (entry->lastUsed != 0 && entry->hash == hash && problemsEqual(&entry->prob, prob))
+		{
+			entry->lastUsed = ++useCounter;
+			problem_cache_stats.hits++;
+			return &entry->frame;
+		}
+	}
+	problem_cache_stats.misses++;
+	return NULL;
+}
+
+// Replaces the least recently used entry
+void problem_cache_store(const problem_t *prob, uint32_t hash, const problem_frame_t *frame)
+{
+	problem_cache_entry_t *victim = &entries[0];
+	for (int i = 1; i < CONFIG_ZBOARD_PROBLEM_CACHE_ENTRIES; i++)
+	{
+		if (entries[i].lastUsed < victim->lastUsed)
+		{
+			victim = &entries[i];
+		}
+	}
+	victim->prob.numHolds = prob->numHolds;
+	victim->prob.bApplyLEDMapping = prob->bApplyLEDMapping;
+	victim->prob.bAdditionalLEDs = prob->bAdditionalLEDs;
+	memcpy(victim->prob.holds, prob->holds, prob->numHolds * sizeof(prob->holds[0]));
+	victim->hash = hash;
+	victim->lastUsed = ++useCounter;
+	victim->frame = *frame;
+}
+
+void problem_cache_clear(void)
+{
+	for (int i = 0; i < CONFIG_ZBOARD_PROBLEM_CACHE_ENTRIES; i++)
+	{
+		entries[i].lastUsed = 0;
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef _PROBLEM_CACHE_H
+#define _PROBLEM_CACHE_H
+
+// Small LRU cache of recently rendered problems and the frames they produced, keyed by a hash of the
+// hold list (CONFIG_ZBOARD_PROBLEM_CACHE). Apps often resend the same problem (after a reconnect, or
+// from several phones), and a repeat then only needs its cached frame to be shown.
+
+#include <stdint.h>
+
+#include "compositor.h"
+#include "zboard.h"
+
+typedef struct problemCacheStats
+{
+    uint32_t hits;
+    uint32_t misses;
+} problem_cache_stats_t;
+
+extern problem_cache_stats_t problem_cache_stats;
+
+uint32_t problem_cache_hash(const problem_t *prob);
+// Returns the cached layers for the problem, or NULL if it isn't cached
+const problem_frame_t *problem_cache_lookup(const problem_t *prob, uint32_t hash);
+void problem_cache_store(const problem_t *prob, uint32_t hash, const problem_frame_t *frame);
+// Drops every cached frame, e.g. when the LED map changes
+void problem_cache_clear(void);
+
+#endif // _PROBLEM_CACHE_H
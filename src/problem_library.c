@@ -0,0 +1,262 @@
+#include "problem_library.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+
+LOG_MODULE_REGISTER(problem_library);
+
+#if !FIXED_PARTITION_EXISTS(library_partition)
+#error CONFIG_ZBOARD_PROBLEM_LIBRARY needs a library_partition flash partition (see nrf52832_mdk.overlay)
+#endif
+
+#define LIBRARY_WRITE_BLOCK DT_PROP(DT_CHOSEN(zephyr_flash), write_block_size)
+#define LIBRARY_ERASE_BLOCK DT_PROP(DT_CHOSEN(zephyr_flash), erase_block_size)
+#define LIBRARY_MAX_CHUNK 256
+
+static const struct flash_area *library;
+static uint32_t uploadSize = 0;	  // Size of the library being uploaded
+static uint16_t numProblems = 0;  // 0 if there's no valid library
+
+// Erase in progress, only used on the system workqueue
+static struct k_work eraseWork;
+static uint32_t eraseAt;  // Next block to erase
+static uint32_t eraseEnd; // 0 if nothing is being erased
+static problem_library_erased_t erasedCb;
+static void *erasedArg;
+
+// Reads the header, and returns the number of problems or a negative error if it isn't a library
+static int readHeader(void)
+{
+	uint8_t header[LIBRARY_HEADER_SIZE];
+	int err = flash_area_read(library, 0, header, sizeof(header));
+	if (err)
+	{
+		return err;
+	}
+	if (memcmp(header, LIBRARY_MAGIC, 4) != 0)
+	{
+		return -ENOENT;
+	}
+	uint16_t count = sys_get_be16(&header[4]);
+	if (LIBRARY_HEADER_SIZE + (uint32_t)count * LIBRARY_INDEX_ENTRY_SIZE > library->fa_size)
+	{
+		return -EINVAL;
+	}
+	return count;
+}
+
+// Erases a block, and queues itself again for the next so that other work runs in between
+static void eraseNextBlock(struct k_work *work)
+{
+	int err = flash_area_erase(library, eraseAt, LIBRARY_ERASE_BLOCK);
+	eraseAt += LIBRARY_ERASE_BLOCK;
+	if (!err && eraseAt < eraseEnd)
+	{
+		k_work_submit(&eraseWork);
+		return;
+	}
+	eraseEnd = 0;
+	if (err)
+	{
+		uploadSize = 0;
+	}
+	erasedCb(err, erasedArg);
+}
+
+int problem_library_init(void)
+{
+	k_work_init(&eraseWork, eraseNextBlock);
+	int err = flash_area_open(FIXED_PARTITION_ID(library_partition), &library);
+	if (err)
+	{
+		LOG_ERR("Failed to open library partition: %d", err);
+		return err;
+	}
+	int count = readHeader();
+	numProblems = count > 0 ? count : 0;
+	LOG_INF("Library has %d problems", numProblems);
+	return 0;
+}
+
+int problem_library_begin(uint32_t size, problem_library_erased_t erased, void *arg)
+{
+	if (!library)
+	{
+		return -ENODEV;
+	}
+	if (eraseEnd)
+	{
+		return -EBUSY;
+	}
+	if (size < LIBRARY_HEADER_SIZE || size > library->fa_size)
+	{
+		return -EFBIG;
+	}
+	numProblems = 0; // The old library is gone as soon as the first block is erased
+	uploadSize = size;
+	eraseAt = 0;
+	eraseEnd = ROUND_UP(size, LIBRARY_ERASE_BLOCK);
+	erasedCb = erased;
+	erasedArg = arg;
+	return k_work_submit(&eraseWork) < 0 ? -EIO : 0;
+}
+
+int problem_library_write(uint32_t offset, const uint8_t *data, size_t len)
+{
+	if (eraseEnd)
+	{
+		return -EBUSY;
+	}
+	if (uploadSize == 0)
+	{
+		return -EPERM;
+	}
+	if (offset % LIBRARY_WRITE_BLOCK || len > LIBRARY_MAX_CHUNK || offset + len > uploadSize)
+	{
+		return -EINVAL;
+	}
+	uint8_t block[LIBRARY_MAX_CHUNK];
+	size_t padded = ROUND_UP(len, LIBRARY_WRITE_BLOCK);
+	memcpy(block, data, len);
+	memset(&block[len], 0xFF, padded - len); // Writing 0xFF leaves the flash erased
+	return flash_area_write(library, offset, block, padded);
+}
+
+// Reads index entry i
+static int readIndexEntry(uint16_t i, uint32_t *id, uint32_t *offset)
+{
+	uint8_t entry[LIBRARY_INDEX_ENTRY_SIZE];
+	int err = flash_area_read(library, LIBRARY_HEADER_SIZE + (uint32_t)i * LIBRARY_INDEX_ENTRY_SIZE, entry, sizeof(entry));
+	if (err)
+	{
+		return err;
+	}
+	*id = sys_get_be32(&entry[0]);
+	*offset = sys_get_be32(&entry[4]);
+	return 0;
+}
+
+int problem_library_finish(void)
+{
+	if (eraseEnd)
+	{
+		return -EBUSY;
+	}
+	if (uploadSize == 0)
+	{
+		return -EPERM;
+	}
+	uint32_t size = uploadSize;
+	uploadSize = 0;
+	int count = readHeader();
+	if (count < 0)
+	{
+		return count;
+	}
+	// Check the whole index once here, so that lookups can trust it
+	uint32_t indexEnd = LIBRARY_HEADER_SIZE + (uint32_t)count * LIBRARY_INDEX_ENTRY_SIZE;
+	uint32_t prevId = 0;
+	for (int i = 0; i < count; i++)
+	{
+		uint32_t id, offset;
+		int err = readIndexEntry(i, &id, &offset);
+		if (err)
+		{
+			return err;
+		}
+		if ((i > 0 && id <= prevId) || offset < indexEnd || offset > size - 2)
+		{
+			LOG_ERR("Library index entry %d is invalid", i);
+			return -EINVAL;
+		}
+		// The record it points to must fit in the library too
+		uint8_t record[2];
+		err = flash_area_read(library, offset, record, sizeof(record));
+		if (err)
+		{
+			return err;
+		}
+		uint8_t numHolds = record[1];
+		if ((record[0] & ~BIN_FLAGS_SUPPORTED) || numHolds > PROBLEM_MAX_HOLDS ||
+			numHolds * sizeof(uint16_t) > size - offset - 2)
+		{
+			LOG_ERR("Library record %d is invalid", i);
+			return -EINVAL;
+		}
+		prevId = id;
+	}
+	numProblems = count;
+	LOG_INF("Library uploaded with %d problems", numProblems);
+	return numProblems;
+}
+
+int problem_library_load(uint32_t id, problem_t *prob)
+{
+	// Binary search of the index, which is sorted by ID
+	int lo = 0;
+	int hi = numProblems - 1;
+	uint32_t offset = 0;
+	bool bFound = false;
+	while (lo <= hi && !bFound)
+	{
+		int mid = lo + (hi - lo) / 2;
+		uint32_t midId;
+		int err = readIndexEntry(mid, &midId, &offset);
+		if (err)
+		{
+			return err;
+		}
+		if (midId == id)
+		{
+			bFound = true;
+		}
+		else if (midId < id)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	if (!bFound)
+	{
+		return -ENOENT;
+	}
+
+	uint8_t record[2 + PROBLEM_MAX_HOLDS * sizeof(uint16_t)];
+	int err = flash_area_read(library, offset, record, 2);
+	if (err)
+	{
+		return err;
+	}
+	uint8_t flags = record[0];
+	uint8_t count = record[1];
+	if ((flags & ~BIN_FLAGS_SUPPORTED) || count > PROBLEM_MAX_HOLDS)
+	{
+		return -EINVAL;
+	}
+	err = flash_area_read(library, offset + 2, &record[2], count * sizeof(uint16_t));
+	if (err)
+	{
+		return err;
+	}
+	prob->bApplyLEDMapping = !(flags & BIN_FLAG_NO_LED_MAPPING);
+	prob->bAdditionalLEDs = flags & BIN_FLAG_ADDITIONAL_LEDS;
+	prob->numHolds = 0;
+	for (int i = 0; i < count; i++)
+	{
+		uint16_t hold = sys_get_be16(&record[2 + 2 * i]);
+		if (HOLD_TYPE(hold) >= NUM_HOLD_TYPES)
+		{
+			return -EINVAL;
+		}
+		prob->holds[prob->numHolds++] = hold;
+	}
+	return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _PROBLEM_LIBRARY_H
+#define _PROBLEM_LIBRARY_H
+
+// Library of problems stored in the library_partition flash partition (CONFIG_ZBOARD_PROBLEM_LIBRARY),
+// so that a problem can be shown by sending just its ID. All values are big-endian:
+//	header	- "ZBL1", number of problems (16 bits), 2 reserved bytes
+//	index	- for each problem, sorted by ID: ID (32 bits), offset of the record from the start of the library (32 bits)
+//	records	- <flags> <count> <hold>{count}, as in binary problem frames (see zboard.c)
+// The library is uploaded in chunks with problem_library_begin()/write()/finish(), and
+// scripts/zboard_proto.py --library builds the upload from text problems.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "zboard.h"
+
+#define LIBRARY_MAGIC "ZBL1"
+#define LIBRARY_HEADER_SIZE 8
+#define LIBRARY_INDEX_ENTRY_SIZE 8
+
+// Called on the system workqueue once the erase started by problem_library_begin() is done, with 0 or a
+// negative error
+typedef void (*problem_library_erased_t)(int err, void *arg);
+
+int problem_library_init(void);
+// Starts erasing enough of the partition for a library of the given size. Erasing takes tens of milliseconds
+// per block, so it is done a block per system workqueue item, letting input be drained and Bluetooth run in
+// between, and erased(err, arg) is called at the end. Until then the other calls return -EBUSY.
+int problem_library_begin(uint32_t size, problem_library_erased_t erased, void *arg);
+// Offset must be a multiple of 4. Data past the end of a chunk whose length isn't a multiple of 4 is left erased.
+int problem_library_write(uint32_t offset, const uint8_t *data, size_t len);
+// Checks the uploaded library and makes it available. Returns the number of problems or a negative error.
+int problem_library_finish(void);
+// Looks the ID up in the index and decodes the problem into prob
+int problem_library_load(uint32_t id, problem_t *prob);
+
+#endif // _PROBLEM_LIBRARY_H
@@ -0,0 +1,140 @@
+#include "rx_ring.h"
+
+#include <string.h>
+
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/util.h>
+
+#define RING_SIZE CONFIG_ZBOARD_RX_RING_SIZE
+#define RING_MASK (RING_SIZE - 1)
+
+BUILD_ASSERT((RING_SIZE & RING_MASK) == 0, "CONFIG_ZBOARD_RX_RING_SIZE must be a power of two");
+
+BUILD_ASSERT((RX_RING_GAPS & (RX_RING_GAPS - 1)) == 0, "RX_RING_GAPS must be a power of two");
+
+static inline uint32_t pendingGaps(rx_ring_t *ring)
+{
+	return (uint32_t)atomic_get(&ring->gapHead) - (uint32_t)atomic_get(&ring->gapTail);
+}
+
+// Producer: true if no more bytes can be stored until the consumer passes a break
+static inline bool gapsFull(rx_ring_t *ring)
+{
+	return pendingGaps(ring) == RX_RING_GAPS;
+}
+
+// Records a break at h, unless the newest break waiting is already there. Nothing is stored while the gap
+// list is full, so a break can always be recorded or merged.
+static void markGap(rx_ring_t *ring, uint32_t h)
+{
+	uint32_t gh = atomic_get(&ring->gapHead);
+	if (pendingGaps(ring) > 0 && ring->gaps[(gh - 1) & (RX_RING_GAPS - 1)] == h)
+	{
+		return;
+	}
+	ring->gaps[gh & (RX_RING_GAPS - 1)] = h;
+	atomic_set(&ring->gapHead, gh + 1);
+}
+
+// Records that len bytes were dropped when head was h. Drops with nothing stored in between are one overrun.
+static void dropped(rx_ring_t *ring, uint32_t h, size_t len)
+{
+	if (ring->stats.bytesDropped == 0 || ring->dropAt != h)
+	{
+		ring->stats.overruns++;
+	}
+	ring->dropAt = h;
+	markGap(ring, h);
+	ring->stats.bytesDropped += len;
+}
+
+// Makes len bytes written at head h available to the consumer
+static void produced(rx_ring_t *ring, uint32_t h, uint32_t used, size_t len)
+{
+	atomic_set(&ring->head, h + len);
+	ring->stats.bytesIn += len;
+	ring->stats.highWater = MAX(ring->stats.highWater, used + len);
+}
+
+size_t rx_ring_fill(rx_ring_t *ring, const struct device *uart)
+{
+	size_t total = 0;
+	for (;;)
+	{
+		uint32_t h = atomic_get(&ring->head);
+		uint32_t used = h - (uint32_t)atomic_get(&ring->tail);
+		if (used == RING_SIZE || gapsFull(ring))
+		{
+			// Drain the FIFO anyway, or the interrupt would keep firing
+			uint8_t discard[16];
+			int n = uart_fifo_read(uart, discard, sizeof(discard));
+			if (n <= 0)
+			{
+				break;
+			}
+			dropped(ring, h, n);
+			continue;
+		}
+		size_t idx = h & RING_MASK;
+		int n = uart_fifo_read(uart, &ring->buf[idx], MIN(RING_SIZE - used, RING_SIZE - idx));
+		if (n <= 0)
+		{
+			break;
+		}
+		produced(ring, h, used, n);
+		total += n;
+	}
+	return total;
+}
+
+size_t rx_ring_put(rx_ring_t *ring, const uint8_t *data, size_t len)
+{
+	size_t total = 0;
+	while (total < len)
+	{
+		uint32_t h = atomic_get(&ring->head);
+		uint32_t used = h - (uint32_t)atomic_get(&ring->tail);
+		if (used == RING_SIZE || gapsFull(ring))
+		{
+			dropped(ring, h, len - total);
+			break;
+		}
+		size_t idx = h & RING_MASK;
+		size_t n = MIN(len - total, MIN(RING_SIZE - used, RING_SIZE - idx));
+		memcpy(&ring->buf[idx], &data[total], n);
+		produced(ring, h, used, n);
+		total += n;
+	}
+	return total;
+}
+
+size_t rx_ring_peek(rx_ring_t *ring, const uint8_t **data)
+{
+	uint32_t t = atomic_get(&ring->tail);
+	uint32_t avail = (uint32_t)atomic_get(&ring->head) - t;
+	if (pendingGaps(ring) > 0)
+	{
+		avail = MIN(avail, ring->gaps[atomic_get(&ring->gapTail) & (RX_RING_GAPS - 1)] - t);
+	}
+	size_t idx = t & RING_MASK;
+	*data = &ring->buf[idx];
+	return MIN(avail, RING_SIZE - idx);
+}
+
+void rx_ring_mark_break(rx_ring_t *ring)
+{
+	markGap(ring, atomic_get(&ring->head));
+}
+
+bool rx_ring_consume(rx_ring_t *ring, size_t len)
+{
+	uint32_t t = (uint32_t)atomic_get(&ring->tail) + len;
+	atomic_set(&ring->tail, t);
+	uint32_t gt = atomic_get(&ring->gapTail);
+	if (pendingGaps(ring) > 0 && ring->gaps[gt & (RX_RING_GAPS - 1)] == t)
+	{
+		atomic_set(&ring->gapTail, gt + 1);
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,57 @@
+#ifndef _RX_RING_H
+#define _RX_RING_H
+
+// Single-producer/single-consumer ring between an input's producer (the UART RX interrupt, which bulk-reads
+// the FIFO with rx_ring_fill(), or the NUS receive callback, with rx_ring_put()) and the parser, which takes
+// contiguous spans with rx_ring_peek()/rx_ring_consume(). Neither side takes a lock: each index is only
+// written by one side. If the ring is full, incoming bytes are dropped, and the consumer is told where the
+// gap is so it can resynchronise. Up to RX_RING_GAPS breaks can wait for the consumer; while that many are
+// waiting, incoming bytes are dropped too, so the next break falls where the last one did.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/device.h>
+#include <zephyr/sys/atomic.h>
+
+#define RX_RING_GAPS 4 // Power of two
+
+typedef struct rxRingStats
+{
+    uint32_t bytesIn;      // bytes stored in the ring
+    uint32_t overruns;     // times the ring was full when data arrived
+    uint32_t bytesDropped; // bytes lost to overruns
+    uint32_t highWater;    // most bytes ever waiting in the ring
+} rx_ring_stats_t;
+
+typedef struct rxRing
+{
+    uint8_t buf[CONFIG_ZBOARD_RX_RING_SIZE];
+    // Free-running byte counts, so the indices are these masked with the ring size and the ring can be
+    // completely full. head is only written by the producer and tail by the consumer.
+    atomic_t head;
+    atomic_t tail;
+    // Breaks the consumer hasn't reached yet, as the value of head at each, oldest first. gapHead counts the
+    // breaks recorded and is only written by the producer, after the entry; gapTail counts the breaks passed
+    // and is only written by the consumer.
+    uint32_t gaps[RX_RING_GAPS];
+    atomic_t gapHead;
+    atomic_t gapTail;
+    uint32_t dropAt;       // Value of head when bytes were last dropped. Only used by the producer.
+    rx_ring_stats_t stats; // Only written by the producer
+} rx_ring_t;
+
+// Producer: reads everything the UART FIFO holds. Only call from the UART interrupt callback.
+size_t rx_ring_fill(rx_ring_t *ring, const struct device *uart);
+// Producer: stores as much of the data as fits
+size_t rx_ring_put(rx_ring_t *ring, const uint8_t *data, size_t len);
+// Consumer: returns the next contiguous span of received bytes, stopping short of any gap
+size_t rx_ring_peek(rx_ring_t *ring, const uint8_t **data);
+// Producer: marks a break in the input, e.g. when a client disconnects part way through a frame
+void rx_ring_mark_break(rx_ring_t *ring);
+// Consumer: frees the span. Returns true if the input breaks right after it, because bytes were dropped
+// or rx_ring_mark_break() was called, so whatever was being parsed is incomplete.
+bool rx_ring_consume(rx_ring_t *ring, size_t len);
+
+#endif // _RX_RING_H
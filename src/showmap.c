@@ -10,19 +10,24 @@
 
 int main(int argc, char *argv[])
 {
-    initialize_led_map();
-
     if (argc == 1)
     {
-        printf("Printing zboard LED map:\n\n");
+        printf("Printing zboard LED map (%s layout):\n\n", led_layout->name);
         for (int i = (NUM_COLS - 1); i >= 0; i--)
         {
-            int z = i * NUM_ROWS;
-            printf("%3c: %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d %4d\n", 'A' + i,
-                   led_map[z + 17], led_map[z + 16], led_map[z + 15], led_map[z + 14], led_map[z + 13], led_map[z + 12], led_map[z + 11], led_map[z + 10], led_map[z + 9],
-                   led_map[z + 8], led_map[z + 7], led_map[z + 6], led_map[z + 5], led_map[z + 4], led_map[z + 3], led_map[z + 2], led_map[z + 1], led_map[z]);
+            printf("%3c:", 'A' + i);
+            for (int r = NUM_ROWS - 1; r >= 0; r--)
+            {
+                printf(" %4d", LED_MAP_COL_ROW(i, r));
+            }
+            printf("\n");
+        }
+        printf("   |\n   |");
+        for (int r = NUM_ROWS; r >= 1; r--)
+        {
+            printf("---%d%s", r, r < 10 ? "-" : "");
         }
-        printf("   |\n   |---18---17---16---15---14---13---12---11---10---9----8----7----6----5----4----3----2----1--|\n");
+        printf("-|\n");
         return 0;
     }
 
@@ -33,11 +38,11 @@ int main(int argc, char *argv[])
         }
         int col = argv[i][0] - 'A';
         int row = atoi(&(argv[i][1]))-1; // Subtract 1 since the rows are 1-indexed in the input but 0-indexed in the code
-        if (row == 0) {
+        if (row < 0 || row >= NUM_ROWS) {
             printf("Invalid row %s\n", &(argv[i][1]));
             continue;
         }
-        printf("Hold at %-3s is LED number %4d\n", argv[i], led_map[col * NUM_ROWS + row]);
+        printf("Hold at %-3s is LED number %4d\n", argv[i], LED_MAP_COL_ROW(col, row));
     }
 
     return 0;
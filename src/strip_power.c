@@ -0,0 +1,117 @@
+#include "strip_power.h"
+
+#include <zephyr/drivers/gpio.h>
+
+#include "trace.h"
+#include "zboard.h"
+
+#define LOG_LEVEL LOG_LEVEL_INF
+LOG_MODULE_REGISTER(strip_power);
+
+#ifdef CONFIG_ZBOARD_STRIP_POWER
+#if !DT_NODE_HAS_PROP(DT_PATH(zephyr_user), strip_power_gpios)
+#error CONFIG_ZBOARD_STRIP_POWER needs the strip-power-gpios property of the zephyr,user node
+#endif
+static const struct gpio_dt_spec rail = GPIO_DT_SPEC_GET(DT_PATH(zephyr_user), strip_power_gpios);
+static struct k_timer offTimer;
+static struct k_work offWork;
+#endif
+
+static K_MUTEX_DEFINE(powerLock); // Protects everything below, since frames are sent from more than one thread
+static strip_power_state_t state;
+static int64_t stateSince; // k_uptime_get() when the state was entered
+static strip_power_stats_t stats;
+
+static void enterState(strip_power_state_t newState)
+{
+	int64_t now = k_uptime_get();
+	stats.stateMs[state] += now - stateSince;
+	stateSince = now;
+	state = newState;
+}
+
+#ifdef CONFIG_ZBOARD_STRIP_POWER
+// Switches the rail off if nothing has been lit since the strip went dark. Runs on the render workqueue.
+static void switchOff(struct k_work *work)
+{
+	k_mutex_lock(&powerLock, K_FOREVER);
+	if (state == STRIP_POWER_DARK)
+	{
+		gpio_pin_set_dt(&rail, 0);
+		TRACE_EVENT(TRACE_STRIP_POWER, 0, (uint32_t)(k_uptime_get() - stateSince));
+		enterState(STRIP_POWER_OFF);
+	}
+	k_mutex_unlock(&powerLock);
+}
+
+static void offTimerExpired(struct k_timer *timer)
+{
+	led_output_submit(&offWork);
+}
+#endif
+
+int strip_power_init(void)
+{
+	stateSince = k_uptime_get();
+#ifdef CONFIG_ZBOARD_STRIP_POWER
+	if (!gpio_is_ready_dt(&rail))
+	{
+		LOG_ERR("Strip power GPIO is not ready");
+		return -ENODEV;
+	}
+	k_timer_init(&offTimer, offTimerExpired, NULL);
+	k_work_init(&offWork, switchOff);
+	state = STRIP_POWER_OFF; // Until there is something to show
+	return gpio_pin_configure_dt(&rail, GPIO_OUTPUT_INACTIVE);
+#else
+	state = STRIP_POWER_DARK;
+	return 0;
+#endif
+}
+
+bool strip_power_up(void)
+{
+	bool bSwitchedOn = false;
+	k_mutex_lock(&powerLock, K_FOREVER);
+#ifdef CONFIG_ZBOARD_STRIP_POWER
+	k_timer_stop(&offTimer);
+	if (state == STRIP_POWER_OFF)
+	{
+		gpio_pin_set_dt(&rail, 1);
+		k_sleep(K_USEC(CONFIG_ZBOARD_STRIP_POWER_SETTLE_US)); // The LEDs ignore data until their supply is up
+		TRACE_EVENT(TRACE_STRIP_POWER, 1, (uint32_t)(k_uptime_get() - stateSince));
+		stats.switchOns++;
+		bSwitchedOn = true;
+	}
+#endif
+	// Lit from now on, so a switch-off that is already queued leaves the rail on for the frame
+	enterState(STRIP_POWER_LIT);
+	k_mutex_unlock(&powerLock);
+	return bSwitchedOn;
+}
+
+void strip_power_frame_shown(bool bDark)
+{
+	k_mutex_lock(&powerLock, K_FOREVER);
+	if (bDark && state == STRIP_POWER_LIT)
+	{
+		enterState(STRIP_POWER_DARK);
+#ifdef CONFIG_ZBOARD_STRIP_POWER
+		k_timer_start(&offTimer, K_MSEC(CONFIG_ZBOARD_STRIP_POWER_OFF_DELAY_MS), K_NO_WAIT);
+#endif
+	}
+	k_mutex_unlock(&powerLock);
+}
+
+bool strip_power_is_on(void)
+{
+	return state != STRIP_POWER_OFF;
+}
+
+void strip_power_get_stats(strip_power_stats_t *out)
+{
+	k_mutex_lock(&powerLock, K_FOREVER);
+	*out = stats;
+	out->stateMs[state] += k_uptime_get() - stateSince;
+	k_mutex_unlock(&powerLock);
+}
@@ -0,0 +1,37 @@
+#ifndef _STRIP_POWER_H
+#define _STRIP_POWER_H
+
+// Keeps track of whether the strip is lit, dark (every LED black) or switched off, and how long it has spent
+// in each state. WS2812 LEDs draw around 1 mA each even when they're dark, which is what limits a session on
+// a battery, so with CONFIG_ZBOARD_STRIP_POWER the strip's power rail (the strip-power-gpios property of the
+// zephyr,user node) is switched off once the strip has been dark for CONFIG_ZBOARD_STRIP_POWER_OFF_DELAY_MS.
+// led_output switches it back on, and waits for it to settle, before sending the next frame that lights
+// anything. The LEDs lose what they were showing while the rail is off, so that frame is sent in full.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum stripPowerState
+{
+    STRIP_POWER_LIT,
+    STRIP_POWER_DARK,
+    STRIP_POWER_OFF,
+    NUM_STRIP_POWER_STATES
+} strip_power_state_t;
+
+typedef struct stripPowerStats
+{
+    uint64_t stateMs[NUM_STRIP_POWER_STATES]; // time spent in each state
+    uint32_t switchOns;                       // times the rail was switched back on
+} strip_power_stats_t;
+
+int strip_power_init(void);
+// Called before a frame that lights anything is sent. Returns true if the rail had to be switched on.
+bool strip_power_up(void);
+// Called once a frame has been sent, so the rail can be switched off after a while if it's dark
+void strip_power_frame_shown(bool bDark);
+bool strip_power_is_on(void);
+// Includes the time spent in the current state so far
+void strip_power_get_stats(strip_power_stats_t *stats);
+
+#endif // _STRIP_POWER_H
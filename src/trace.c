@@ -0,0 +1,36 @@
+#include "trace.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#define TRACE_ENTRIES CONFIG_ZBOARD_TRACE_ENTRIES
+#define TRACE_MASK (TRACE_ENTRIES - 1)
+
+BUILD_ASSERT((TRACE_ENTRIES & TRACE_MASK) == 0, "CONFIG_ZBOARD_TRACE_ENTRIES must be a power of two");
+
+uint8_t trace_verbosity = TRACE_VERBOSITY_NONE;
+
+static trace_event_t events[TRACE_ENTRIES];
+static atomic_t numWritten; // Free-running, so the next event goes in events[numWritten & TRACE_MASK]
+
+void trace_event(trace_event_id_t id, uint16_t a, uint32_t b)
+{
+	// Each writer reserves its own slot, so events from different threads and interrupts never share one
+	trace_event_t *ev = &events[(uint32_t)atomic_inc(&numWritten) & TRACE_MASK];
+	ev->cycles = k_cycle_get_32();
+	ev->id = id;
+	ev->a = a;
+	ev->b = b;
+}
+
+// An event being written while the ring is read may be copied half written, which the dump tolerates
+int trace_read(trace_event_t *out, int max)
+{
+	uint32_t written = (uint32_t)atomic_get(&numWritten);
+	int count = MIN(MIN(written, (uint32_t)TRACE_ENTRIES), (uint32_t)max);
+	for (int i = 0; i < count; i++)
+	{
+		out[i] = events[(written - count + i) & TRACE_MASK];
+	}
+	return count;
+}
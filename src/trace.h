@@ -0,0 +1,68 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+// Binary event trace (CONFIG_ZBOARD_TRACE). Each event is a fixed-size record of a cycle counter
+// timestamp, an event ID and two arguments, written to a RAM ring that always holds the most recent
+// CONFIG_ZBOARD_TRACE_ENTRIES events. Recording one is a reservation with an atomic increment and a few
+// stores, so events can be traced from the hot path where a log message per hold would cost more than
+// the work itself. The 'd' input command dumps the ring, which scripts/zboard_trace.py decodes.
+//
+// The per-hold and per-byte log messages are only produced if the runtime verbosity (the 'v' input
+// command) is high enough, see TRACE_VERBOSE().
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/sys/atomic.h>
+
+// Event IDs are part of the dump format, so only ever add to the end (and to scripts/zboard_trace.py)
+typedef enum traceEventId
+{
+    TRACE_RX,                // a: input, b: bytes received
+    TRACE_RX_BREAK,          // a: input, b: bytes dropped on that input so far
+    TRACE_PROBLEM_COMPLETE,  // a: input, b: number of holds
+    TRACE_PROBLEM_DROPPED,   // a: number of holds of the pending problem that was replaced
+    TRACE_RENDER_START,      // a: number of holds
+    TRACE_CACHE_HIT,         // b: hash of the problem
+    TRACE_HOLD,              // a: hold (HOLD_PACK()), b: LED number
+    TRACE_HOLD_ADDITIONAL,   // a: hold (HOLD_PACK()), b: LED number of the additional LED
+    TRACE_HOLD_OUT_OF_RANGE, // a: hold (HOLD_PACK())
+    TRACE_RENDER_DONE,       // a: LEDs lit, b: result of led_output_flip()
+    TRACE_PATTERN_FRAME,     // a: frame number
+    TRACE_PLAYLIST_SHOW,     // a: playlist entry, b: 1 if it was already composed
+    TRACE_STRIP_POWER,       // a: 1 if the strip was switched on, 0 if off, b: ms spent in the previous state
+    NUM_TRACE_EVENTS
+} trace_event_id_t;
+
+typedef struct traceEvent
+{
+    uint32_t cycles; // k_cycle_get_32()
+    uint16_t id;     // trace_event_id_t
+    uint16_t a;
+    uint32_t b;
+} trace_event_t;
+
+// Log message verbosity levels
+#define TRACE_VERBOSITY_NONE 0  // Trace events only
+#define TRACE_VERBOSITY_HOLDS 1 // Also log each problem and hold as it is rendered
+#define TRACE_VERBOSITY_BYTES 2 // Also log each byte as it is parsed (with debug logging enabled)
+
+#ifdef CONFIG_ZBOARD_TRACE
+
+extern uint8_t trace_verbosity;
+
+void trace_event(trace_event_id_t id, uint16_t a, uint32_t b);
+// Copies out up to max of the most recent events, oldest first. Returns the number copied.
+int trace_read(trace_event_t *events, int max);
+
+#define TRACE_EVENT(id, a, b) trace_event((id), (a), (b))
+#define TRACE_VERBOSE(level) (trace_verbosity >= (level))
+
+#else
+
+#define TRACE_EVENT(id, a, b) ((void)0)
+#define TRACE_VERBOSE(level) true // Without the trace, everything is logged as before
+
+#endif // CONFIG_ZBOARD_TRACE
+
+#endif // _TRACE_H
@@ -1,21 +1,47 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "zboard.h"
 
+#include "ble_link.h"
+#include "compositor.h"
+#include "latency_stats.h"
 #include "led_map.h"
+#include "led_map_generated.h"
 #include "led_patterns.h"
+#include "playlist.h"
+#include "problem_cache.h"
+#include "problem_library.h"
+#include "rx_ring.h"
+#include "strip_power.h"
+#include "trace.h"
 
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gap.h>
+#include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/hci.h>
 #include <zephyr/bluetooth/services/nus.h>
 #include <zephyr/drivers/uart.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
 
 #define LOG_LEVEL LOG_LEVEL_INF
 LOG_MODULE_REGISTER(zboard);
 
+#if LED_MAP_GENERATED_MAX_LED >= STRIP_LENGTH
+#error The LED map uses more LEDs than the strip has (chain-length)
+#endif
+
 #define UART_NODE DT_ALIAS(zboard_input)
 #define STRIP_NODE DT_ALIAS(led_strip)
 
+// Input comes from each BLE client over NUS and from the zboard-input UART. Every client has its own
+// parser, so clients can send at the same time, and replies go back to the client that asked.
+// Completed problems are rendered in turn (see CONFIG_ZBOARD_PROBLEM_QUEUE_DEPTH).
+//
 // Problem string structure:
 // V1:
 //	<holdtype>=[SPE]
@@ -33,8 +59,55 @@ LOG_MODULE_REGISTER(zboard);
 // x<holdnum>,<holdnum>,<holdnum>#  (doesn't apply LED mapping)
 // t# or x# 	- clear board
 // r			- show random LED pattern from led_patterns.h
-
-struct led_rgb pixels[STRIP_LENGTH];
+// f			- reply with the pattern frames shown, late and dropped, e.g. "frames 120/3/1"
+// o			- reply with the milliseconds the strip has spent lit, dark and switched off, and the number of
+//				  times it was switched back on, e.g. "power 81200/4100/903000 12" (see strip_power.h)
+// i			- with CONFIG_ZBOARD_BLE_LINK, reply with the link parameters of each BLE connection, one line per
+//				  client of "link <client> <tx PHY>/<rx PHY> <tx>/<rx data length> <MTU> <interval us> <latency>
+//				  <fast|idle> <times relaxed>", e.g. "link 0 2M/2M 251/251 247 15000 0 fast 3" (see ble_link.h)
+// Binary (all multi-byte values big-endian):
+//	0xB5 <flags> <count> <hold>{count} <crc16>
+//	<flags>	- bit 0: light the LED above each hold (as 'D'), bit 1: hold numbers are LED numbers (as 'x')
+//	<count>	- number of holds, up to PROBLEM_MAX_HOLDS
+//	<hold>	- 16 bits: hold type (hold_type_t, 1=S 2=P 3=E 4=L 5=R 6=M 7=F) in the top 4 bits, hold number in the rest
+//	<crc16>	- CRC-16/MCRF4XX (crc16_ccitt() seeded with 0xFFFF) of <flags>, <count> and the holds
+//	scripts/zboard_proto.py converts text problems to binary frames.
+// Problem library (see problem_library.h):
+// p<id>#		- show problem <id> from the library. Replies "lib p <error>" if it can't be shown.
+//	0xB6 <op> <len> <payload>{len} <crc16>	- library upload frame, with the CRC of <op>, <len> and <payload>
+//	<op>	- 'B' <size (32 bits)>: start an upload, 'W' <offset (32 bits)> <data>: write a chunk, 'E': finish
+//	Each frame is answered with "lib <op> <result>", where <result> is 0 (the number of problems for 'E') or a
+//	negative error. Wait for it before sending the next frame, so that the upload doesn't overrun the receive ring.
+//	The reply to 'B' comes once the old library has been erased, which can take a few seconds for a big one.
+//	scripts/zboard_proto.py --library builds the upload from text problems.
+// Playlist (see playlist.h):
+// u<count>#	- the next <count> problems from this input (of any kind, including p<id>#) make up the playlist
+//				  instead of being shown. Replies "list <count>" and shows the first once they have all arrived,
+//				  or "list <error>" straight away if there are too many, or "list -16" (-EBUSY) while another
+//				  input is uploading. u# empties the playlist.
+// > or <		- show the next or previous problem in the playlist. Replies "list <error>" if it is empty.
+// ?			- reply with the supported protocols, e.g. "zboard text bin1 lib1 list1"
+// c			- reply with the problem cache hits and misses, e.g. "cache 12/30"
+// s			- reply with the latency of each stage of showing a problem, one line per stage of
+//				  "lat <stage> <count> <min>/<p50>/<p99>/<max>" in microseconds (see latency_stats.h)
+// d			- dump the event trace, as "trace <count> <cycles per second>" and then a line per event of
+//				  "<cycles> <event> <a> <b>" in hex, oldest first. scripts/zboard_trace.py decodes it (see trace.h).
+// v<level>		- set how much is logged: 0 - trace events only, 1 - also each problem and hold, 2 - also each byte
+// n1 or n0		- with CONFIG_ZBOARD_RENDER_ACKS, turn acks on or off for this client. n1 restarts the sequence, and
+//				  then each problem it sends (text, binary or p<id>#) is answered with "ack <seq> <status> <us>" once
+//				  it has been shown or added to the playlist, e.g. "ack 1 ok 840". <seq> counts the problems from 1,
+//				  <status> is one of ack_status_names and <us> is the time taken to render and send it.
+//				  Sending the next problem as soon as the ack arrives avoids fixed delays between problems.
+// Configuration:
+// w[LR][TB](,<lednum>)*#	- set the wiring (see Kconfig): columns go L-to-R or R-to-L, first LED at the
+//							  top or bottom, followed by the LEDs to skip in the first column. Saved in settings.
+// w#						- go back to the wiring the firmware was built with
+// b<index>#				- with CONFIG_ZBOARD_LAYOUT_RUNTIME, switch to the board layout led_layouts[<index>] (see
+//							  led_map.h), 0 being the one selected in Kconfig. Saved in settings.
+// b#						- reply with the layout in use as "layout <index> <name> <cols>x<rows>", e.g.
+//							  "layout 0 moonboard 11x18". b<index># replies the same, or "layout <error>".
+// k<index>,<r>,<g>,<b>#	- with CONFIG_ZBOARD_FRAMEBUFFER_PALETTE, show color_list[<index>] as the given colour (0-255
+//							  each), e.g. k1,0,0,64# for dimmer starts. Only the LEDs using it are re-sent. k# restores the palette.
 
 const struct device *const strip = DEVICE_DT_GET(STRIP_NODE);
 static const struct device *const uart_in = DEVICE_DT_GET(UART_NODE);
@@ -51,79 +124,869 @@ static const struct bt_data sd[] = {
 	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_NUS_SRV_VAL),
 };
 
-struct k_work drainUARTWork;
-struct k_work randomPatternWork;
+struct k_work drainInputWork;
 struct k_work renderProblemWork;
 
-parse_state_t parse_state = PARSE_START;		  // Current state of the problem string parser
-char parseBuffer[PROBLEM_STRING_MAX_LENGTH] = ""; // Problem currently being received
-int parseBufferPos = 0;
-char strProblem[PROBLEM_STRING_MAX_LENGTH] = "";	   // Complete problem string
-char strProblemBackup[PROBLEM_STRING_MAX_LENGTH] = ""; // Copy of complete problem string
-bool bProbPending = false;							   // Do we have a problem ready to display?
-bool bAdditionalLEDs = false;						   // Additional LED setting
-bool bTestMode = false;
-bool bApplyLEDMapping = true;
+input_context_t inputs[NUM_INPUTS];
+static struct k_spinlock connLock; // Protects the conn of each input, which the Bluetooth RX thread sets and clears
+
+// Holds are decoded as they arrive into each input's parsing problem. When a problem is complete it is
+// swapped into the pending queue, and renderProblem() swaps the oldest pending problem with the one it
+// renders from, so the parser never writes to a problem that is being rendered. If the queue is full the
+// oldest pending problem is dropped, so with the default depth of 1 the last problem completed wins.
+#define QUEUE_DEPTH CONFIG_ZBOARD_PROBLEM_QUEUE_DEPTH
+problem_t problemBuffers[NUM_INPUTS + QUEUE_DEPTH + 1];
+problem_t *pendingProblems[QUEUE_DEPTH]; // Oldest first
+problem_t *freeProblems[QUEUE_DEPTH];	 // Buffers not in use, one for each free queue slot
+problem_t *renderingProblem = &problemBuffers[NUM_INPUTS + QUEUE_DEPTH];
+int numPending = 0;
+struct k_spinlock problemLock; // Protects pendingProblems, freeProblems and numPending
+
+static const color_t *const hold_colors[NUM_HOLD_TYPES] = {
+	[HOLD_NONE] = &COLOR_BLACK,
+	[HOLD_START] = &COLOR_GREEN,
+	[HOLD_PROGRESS] = &COLOR_BLUE,
+	[HOLD_END] = &COLOR_RED,
+	[HOLD_LEFT] = &COLOR_VIOLET,
+	[HOLD_RIGHT] = &COLOR_BLUE,
+	[HOLD_MATCH] = &COLOR_PINK,
+	[HOLD_FOOT] = &COLOR_CYAN,
+};
+
+// Optional protocols listed in the reply to '?'
+#ifdef CONFIG_ZBOARD_PROBLEM_LIBRARY
+#define PROTOCOL_LIBRARY " lib1"
+#else
+#define PROTOCOL_LIBRARY ""
+#endif
+#ifdef CONFIG_ZBOARD_PLAYLIST
+#define PROTOCOL_PLAYLIST " list1"
+#else
+#define PROTOCOL_PLAYLIST ""
+#endif
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+#define PROTOCOL_ACKS " ack1"
+#else
+#define PROTOCOL_ACKS ""
+#endif
+
+static const char hold_type_chars[NUM_HOLD_TYPES] = {'?', 'S', 'P', 'E', 'L', 'R', 'M', 'F'}; // For logging
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+static const char *const ack_status_names[NUM_ACK_STATUSES] = {
+	[ACK_OK] = "ok",
+	[ACK_BAD_HOLD] = "badhold",
+	[ACK_OVERFLOW] = "overflow",
+	[ACK_INVALID] = "invalid",
+	[ACK_FULL] = "full",
+	[ACK_DROPPED] = "dropped",
+	[ACK_FAILED] = "failed",
+};
+#endif
+
+void handleChar(input_context_t *ctx, char);
+static void sendReply(input_context_t *ctx, const char *reply);
+
+static hold_type_t holdTypeFromChar(char c)
+{
+	switch (c)
+	{
+	case 'S':
+	case 's':
+		return HOLD_START;
+	case 'P':
+	case 'p':
+		return HOLD_PROGRESS;
+	case 'E':
+	case 'e':
+		return HOLD_END;
+	case 'L':
+	case 'l':
+		return HOLD_LEFT;
+	case 'R':
+	case 'r':
+		return HOLD_RIGHT;
+	case 'M':
+	case 'm':
+		return HOLD_MATCH;
+	case 'F':
+	case 'f':
+		return HOLD_FOOT;
+	}
+	return HOLD_NONE;
+}
+
+static void startHold(input_context_t *ctx)
+{
+	ctx->holdType = ctx->bTestMode ? HOLD_PROGRESS : HOLD_NONE; // Test mode holds have no hold type and are shown as P
+	ctx->holdNum = 0;
+	ctx->holdDigits = 0;
+}
+
+// Adds the hold that has just been parsed to the problem. Returns false if the problem is full.
+static bool finishHold(input_context_t *ctx)
+{
+	if (ctx->holdDigits == 0) // Empty hold spec, e.g. "t#" to clear the board
+	{
+		return true;
+	}
+	if (ctx->parsingProblem->numHolds >= PROBLEM_MAX_HOLDS)
+	{
+		return false;
+	}
+	ctx->parsingProblem->holds[ctx->parsingProblem->numHolds++] = HOLD_PACK(ctx->holdType, MIN(ctx->holdNum, HOLD_NUM_MAX));
+	return true;
+}
+
+static void startProblem(input_context_t *ctx, bool bApplyLEDMapping, bool bAdditionalLEDs)
+{
+	ctx->parsingProblem->numHolds = 0;
+	ctx->parsingProblem->bApplyLEDMapping = bApplyLEDMapping;
+	ctx->parsingProblem->bAdditionalLEDs = bAdditionalLEDs;
+	startHold(ctx);
+}
+
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+// Tells the client what became of one of its problems, if it asked with n1. Only called on the system
+// workqueue, so that a client that is slow to take its replies never holds up rendering.
+static void sendAck(input_context_t *ctx, uint16_t seq, ack_status_t status, uint32_t renderUs)
+{
+	if (!ctx->bAcks)
+	{
+		return;
+	}
+	char reply[40];
+	snprintf(reply, sizeof(reply), "ack %u %s %u\r\n", seq, ack_status_names[status], renderUs);
+	sendReply(ctx, reply);
+}
+#endif
+
+// A problem that was received but can't be shown still uses up a sequence number, so the client isn't left waiting
+static void rejectProblem(input_context_t *ctx, ack_status_t status)
+{
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+	sendAck(ctx, ++ctx->ackSeq, status, 0);
+#endif
+}
+
+// Acks a problem that has been through publishProblem() to the client that sent it
+static void ackProblem(const problem_t *prob, ack_status_t status, uint32_t renderUs)
+{
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+	sendAck(&inputs[prob->source], prob->seq, status, renderUs);
+#endif
+}
+
+#ifdef CONFIG_ZBOARD_PLAYLIST
+// There is one playlist, so only one input may be uploading to it. Only used by the parser.
+static input_context_t *playlistOwner; // NULL if no upload is in progress
+static int playlistLeft; // Problems of the upload still to come
+
+static void endPlaylistUpload(void)
+{
+	playlistOwner = NULL;
+	playlistLeft = 0;
+}
+
+static void sendPlaylistResult(input_context_t *ctx, int rc)
+{
+	char reply[24];
+	snprintf(reply, sizeof(reply), "list %d\r\n", rc);
+	sendReply(ctx, reply);
+}
+
+// Starts a playlist upload once the final '#' is received
+static void startPlaylist(input_context_t *ctx)
+{
+	if (ctx->holdNum > CONFIG_ZBOARD_PLAYLIST_ENTRIES)
+	{
+		sendPlaylistResult(ctx, -ENOSPC);
+		return;
+	}
+	if (playlistOwner && playlistOwner != ctx)
+	{
+		sendPlaylistResult(ctx, -EBUSY);
+		return;
+	}
+	playlist_clear();
+	if (ctx->holdNum == 0)
+	{
+		endPlaylistUpload();
+		sendPlaylistResult(ctx, 0);
+		return;
+	}
+	playlistOwner = ctx;
+	playlistLeft = ctx->holdNum;
+}
+
+// Adds the parsed problem to the playlist being uploaded, and shows the first once they are all in
+static void addToPlaylist(input_context_t *ctx)
+{
+	int rc = playlist_add(ctx->parsingProblem);
+	ackProblem(ctx->parsingProblem, rc < 0 ? ACK_FULL : ACK_OK, 0);
+	if (rc < 0 || --playlistLeft == 0)
+	{
+		endPlaylistUpload();
+		sendPlaylistResult(ctx, rc);
+		playlist_show(0);
+	}
+}
+
+static void stepPlaylist(input_context_t *ctx, int delta)
+{
+	int rc = playlist_step(delta);
+	if (rc)
+	{
+		sendPlaylistResult(ctx, rc);
+	}
+}
+#endif
+
+// Hands the parsed problem over to renderProblem(), stopping any pattern that is running
+static void publishProblem(input_context_t *ctx)
+{
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+	ctx->parsingProblem->source = ctx - inputs;
+	ctx->parsingProblem->seq = ++ctx->ackSeq;
+#endif
+#ifdef CONFIG_ZBOARD_PLAYLIST
+	if (ctx == playlistOwner)
+	{
+		addToPlaylist(ctx);
+		return;
+	}
+#endif
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+	ctx->parsingProblem->rxCycles = ctx->rxCycles;
+	ctx->parsingProblem->completeCycles = k_cycle_get_32();
+#endif
+	led_pattern_cancel();
+	k_spinlock_key_t key = k_spin_lock(&problemLock);
+	problem_t *spare;
+	problem_t *dropped = NULL;
+	if (numPending == QUEUE_DEPTH)
+	{
+		spare = dropped = pendingProblems[0]; // Drop the oldest
+		TRACE_EVENT(TRACE_PROBLEM_DROPPED, spare->numHolds, 0);
+		memmove(&pendingProblems[0], &pendingProblems[1], (QUEUE_DEPTH - 1) * sizeof(pendingProblems[0]));
+		numPending--;
+	}
+	else
+	{
+		spare = freeProblems[QUEUE_DEPTH - 1 - numPending];
+	}
+	TRACE_EVENT(TRACE_PROBLEM_COMPLETE, ctx - inputs, ctx->parsingProblem->numHolds);
+	pendingProblems[numPending++] = ctx->parsingProblem;
+	ctx->parsingProblem = spare;
+	k_spin_unlock(&problemLock, key);
+	led_output_submit(&renderProblemWork);
+	if (dropped) // Now this input's parsing problem, so it won't change until more data is parsed
+	{
+		ackProblem(dropped, ACK_DROPPED, 0);
+	}
+}
+
+// Drops the frames that were rendered with the old LED map
+static void mapChanged(void)
+{
+#ifdef CONFIG_ZBOARD_PROBLEM_CACHE
+	problem_cache_clear();
+#endif
+#ifdef CONFIG_ZBOARD_PLAYLIST
+	playlist_invalidate();
+#endif
+}
+
+// Applies and saves the wiring once the final '#' is received
+static void applyWiring(input_context_t *ctx, bool bReset)
+{
+	int err = led_map_set_wiring(bReset ? NULL : &ctx->parseWiring);
+	if (err)
+	{
+		return;
+	}
+	mapChanged();
+	err = led_map_save_wiring();
+	if (err && err != -ENOTSUP)
+	{
+		LOG_ERR("Failed to save wiring: %d", err);
+	}
+}
+
+// Switches to the layout given, if any, once the final '#' is received and replies with the layout in use
+static void applyLayout(input_context_t *ctx)
+{
+	int err = 0;
+	if (ctx->holdDigits > 0)
+	{
+		err = led_map_set_layout(ctx->holdNum);
+		if (!err)
+		{
+			mapChanged();
+			int saveErr = led_map_save_layout();
+			if (saveErr && saveErr != -ENOTSUP)
+			{
+				LOG_ERR("Failed to save layout: %d", saveErr);
+			}
+		}
+	}
+
+	char reply[48];
+	if (err)
+	{
+		snprintf(reply, sizeof(reply), "layout %d\r\n", err);
+	}
+	else
+	{
+		snprintf(reply, sizeof(reply), "layout %d %s %dx%d\r\n", (int)(led_layout - led_layouts), led_layout->name,
+				 NUM_COLS, NUM_ROWS);
+	}
+	sendReply(ctx, reply);
+}
+
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+// Returns false if the palette command is invalid
+static bool handlePaletteChar(input_context_t *ctx, char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		ctx->holdNum = ctx->holdNum * 10 + (c - '0');
+		return ++ctx->holdDigits <= 3 && ctx->holdNum <= UINT8_MAX;
+	}
+	if (c == '#' && ctx->paletteToken == 0 && ctx->holdDigits == 0)
+	{
+		led_output_reset_palette();
+		ctx->parse_state = PARSE_START;
+		return true;
+	}
+	if (ctx->holdDigits == 0)
+	{
+		return false;
+	}
+	if (c == ',' && ctx->paletteToken < ARRAY_SIZE(ctx->paletteValues))
+	{
+		ctx->paletteValues[ctx->paletteToken++] = ctx->holdNum;
+		ctx->holdNum = 0;
+		ctx->holdDigits = 0;
+		return true;
+	}
+	if (c == '#' && ctx->paletteToken == ARRAY_SIZE(ctx->paletteValues))
+	{
+		struct led_rgb rgb = RGB(ctx->paletteValues[1], ctx->paletteValues[2], ctx->holdNum);
+		ctx->parse_state = PARSE_START;
+		return led_output_set_palette(ctx->paletteValues[0], rgb) == 0;
+	}
+	return false;
+}
+#endif
+
+// Returns false if the wiring configuration is invalid
+static bool handleWiringChar(input_context_t *ctx, char c)
+{
+	if (c >= '0' && c <= '9' && ctx->wiringToken > 0)
+	{
+		ctx->holdNum = ctx->holdNum * 10 + (c - '0');
+		return ++ctx->holdDigits <= 2; // Skipped LED numbers are below WIRING_MAX_COLUMN_LEDS
+	}
+	if (c == ',' || c == '#')
+	{
+		if (ctx->wiringToken > 0)
+		{
+			if (ctx->holdDigits == 0 || ctx->holdNum >= WIRING_MAX_COLUMN_LEDS)
+			{
+				return false;
+			}
+			ctx->parseWiring.skipMask |= 1ULL << ctx->holdNum;
+		}
+		else if (ctx->wiringFlags != 0 && ctx->wiringFlags != WIRING_FLAGS_COMPLETE) // Need one of L/R and one of T/B
+		{
+			return false;
+		}
+		if (c == '#')
+		{
+			applyWiring(ctx, ctx->wiringFlags == 0);
+			ctx->parse_state = PARSE_START;
+			return true;
+		}
+		ctx->wiringToken++;
+		ctx->holdNum = 0;
+		ctx->holdDigits = 0;
+		return ctx->wiringFlags == WIRING_FLAGS_COMPLETE;
+	}
+	if (ctx->wiringToken > 0)
+	{
+		return false;
+	}
+	switch (c)
+	{
+	case 'L':
+	case 'l':
+	case 'R':
+	case 'r':
+		ctx->parseWiring.bFirstLEDRight = (c == 'R' || c == 'r');
+		ctx->wiringFlags |= WIRING_FLAG_HORIZONTAL;
+		return true;
+	case 'T':
+	case 't':
+	case 'B':
+	case 'b':
+		ctx->parseWiring.bFirstLEDBottom = (c == 'B' || c == 'b');
+		ctx->wiringFlags |= WIRING_FLAG_VERTICAL;
+		return true;
+	}
+	return false;
+}
+
+#define REPLY_RETRIES 3
+#define REPLY_RETRY_MS 10
+static uint32_t repliesDropped = 0;
 
-void handleChar(char);
+// Replies to whichever client the input came from
+static void sendReply(input_context_t *ctx, const char *reply)
+{
+	if (ctx == &inputs[INPUT_UART])
+	{
+		k_mutex_lock(&ctx->replyLock, K_FOREVER);
+		while (*reply)
+		{
+			uart_poll_out(uart_in, *reply++);
+		}
+		k_mutex_unlock(&ctx->replyLock);
+		return;
+	}
+	// Held until the reply is sent, since the client can disconnect meanwhile
+	k_spinlock_key_t key = k_spin_lock(&connLock);
+	struct bt_conn *conn = ctx->conn ? bt_conn_ref(ctx->conn) : NULL;
+	k_spin_unlock(&connLock, key);
+	if (!conn)
+	{
+		return;
+	}
+	k_mutex_lock(&ctx->replyLock, K_FOREVER); // The chunks of a reply go out together, however long they wait
+	// A notification carries at most the ATT MTU less 3 bytes, which is 20 until the MTU has been exchanged
+	size_t len = strlen(reply);
+	size_t maxLen = bt_gatt_get_mtu(conn) - 3;
+	int retries = REPLY_RETRIES;
+	for (size_t sent = 0; sent < len;)
+	{
+		size_t n = MIN(len - sent, maxLen);
+		int err = bt_nus_send(conn, &reply[sent], n);
+		if (err == -ENOMEM && retries-- > 0)
+		{
+			k_sleep(K_MSEC(REPLY_RETRY_MS)); // Out of buffers until the queued notifications have gone out
+			continue;
+		}
+		if (err)
+		{
+			repliesDropped++;
+			LOG_WRN("Reply to client %d dropped: %d (%u so far)", (int)(ctx - inputs), err, repliesDropped);
+			break;
+		}
+		sent += n;
+	}
+	k_mutex_unlock(&ctx->replyLock);
+	bt_conn_unref(conn);
+}
+
+#ifdef CONFIG_ZBOARD_TRACE
+static void sendTrace(input_context_t *ctx)
+{
+	static trace_event_t events[CONFIG_ZBOARD_TRACE_ENTRIES]; // Only the parser's thread dumps the trace
+	int count = trace_read(events, ARRAY_SIZE(events));
+	char reply[40];
+	k_mutex_lock(&ctx->replyLock, K_FOREVER); // Nothing else gets between the lines of the dump
+	snprintf(reply, sizeof(reply), "trace %d %u\r\n", count, sys_clock_hw_cycles_per_sec());
+	sendReply(ctx, reply);
+	for (int i = 0; i < count; i++)
+	{
+		snprintf(reply, sizeof(reply), "%08x %x %x %x\r\n", events[i].cycles, events[i].id, events[i].a, events[i].b);
+		sendReply(ctx, reply);
+	}
+	k_mutex_unlock(&ctx->replyLock);
+}
+#endif
 
-void clearStrip(bool updateStrip)
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+static void sendLatencyStats(input_context_t *ctx)
 {
-	for (int i = 0; i < STRIP_LENGTH; i++)
+	k_mutex_lock(&ctx->replyLock, K_FOREVER);
+	for (int i = 0; i < NUM_LATENCY_STAGES; i++)
 	{
-		pixels[i] = COLOR_BLACK.rgb;
+		latency_summary_t summary;
+		latency_stats_summary(i, &summary);
+		char reply[64];
+		snprintf(reply, sizeof(reply), "lat %s %u %u/%u/%u/%u\r\n", latency_stage_names[i], summary.count,
+				 summary.minUs, summary.p50Us, summary.p99Us, summary.maxUs);
+		sendReply(ctx, reply);
 	}
-	if (!updateStrip)
+	k_mutex_unlock(&ctx->replyLock);
+}
+#endif
+
+#ifdef CONFIG_ZBOARD_BLE_LINK
+static const char *phyName(uint8_t phy)
+{
+	switch (phy)
 	{
+	case BT_GAP_LE_PHY_1M:
+		return "1M";
+	case BT_GAP_LE_PHY_2M:
+		return "2M";
+	case BT_GAP_LE_PHY_CODED:
+		return "coded";
+	}
+	return "?";
+}
+
+static void sendLinkInfo(input_context_t *ctx)
+{
+	k_mutex_lock(&ctx->replyLock, K_FOREVER);
+	int numConnected = 0;
+	for (int i = 0; i < CONFIG_BT_MAX_CONN; i++)
+	{
+		ble_link_info_t info;
+		if (ble_link_get_info(i, &info))
+		{
+			continue;
+		}
+		char reply[80];
+		snprintf(reply, sizeof(reply), "link %d %s/%s %u/%u %u %u %u %s %u\r\n", i, phyName(info.txPhy),
+				 phyName(info.rxPhy), info.txMaxLen, info.rxMaxLen, info.mtu, info.interval * 1250, info.latency,
+				 info.bIdle ? "idle" : "fast", info.relaxes);
+		sendReply(ctx, reply);
+		numConnected++;
+	}
+	if (numConnected == 0)
+	{
+		sendReply(ctx, "link none\r\n");
+	}
+	k_mutex_unlock(&ctx->replyLock);
+}
+#endif
+
+// Handles a byte of a binary problem frame. Returns -E2BIG if it has too many holds, or -EINVAL if it is
+// otherwise invalid.
+static int handleBinaryByte(input_context_t *ctx, uint8_t b)
+{
+	if (ctx->parse_state != PARSE_BIN_CRC)
+	{
+		ctx->binCRC = crc16_ccitt(ctx->binCRC, &b, 1);
+	}
+	switch (ctx->parse_state)
+	{
+	case PARSE_BIN_FLAGS:
+		if (b & ~BIN_FLAGS_SUPPORTED)
+		{
+			return -EINVAL;
+		}
+		startProblem(ctx, !(b & BIN_FLAG_NO_LED_MAPPING), b & BIN_FLAG_ADDITIONAL_LEDS);
+		ctx->parse_state = PARSE_BIN_COUNT;
+		return 0;
+	case PARSE_BIN_COUNT:
+		if (b > PROBLEM_MAX_HOLDS)
+		{
+			return -E2BIG;
+		}
+		ctx->binHoldsLeft = b;
+		ctx->binBytesLeft = 2;
+		ctx->binValue = 0;
+		ctx->parse_state = b ? PARSE_BIN_HOLDS : PARSE_BIN_CRC;
+		return 0;
+	case PARSE_BIN_HOLDS:
+		ctx->binValue = (ctx->binValue << 8) | b;
+		if (--ctx->binBytesLeft > 0)
+		{
+			return 0;
+		}
+		if (HOLD_TYPE(ctx->binValue) >= NUM_HOLD_TYPES)
+		{
+			return -EINVAL;
+		}
+		ctx->parsingProblem->holds[ctx->parsingProblem->numHolds++] = ctx->binValue;
+		ctx->binBytesLeft = 2;
+		ctx->binValue = 0;
+		if (--ctx->binHoldsLeft == 0)
+		{
+			ctx->parse_state = PARSE_BIN_CRC;
+		}
+		return 0;
+	case PARSE_BIN_CRC:
+		ctx->binValue = (ctx->binValue << 8) | b;
+		if (--ctx->binBytesLeft > 0)
+		{
+			return 0;
+		}
+		if (ctx->binValue != ctx->binCRC)
+		{
+			return -EINVAL;
+		}
+		LOG_DBG("Received complete binary problem");
+		publishProblem(ctx);
+		ctx->parse_state = PARSE_START;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+#ifdef CONFIG_ZBOARD_PROBLEM_LIBRARY
+static void showLibraryProblem(input_context_t *ctx)
+{
+	int err = problem_library_load(ctx->libraryId, ctx->parsingProblem);
+	if (err)
+	{
+		LOG_WRN("Failed to load problem %u from the library: %d", ctx->libraryId, err);
+		char reply[24];
+		snprintf(reply, sizeof(reply), "lib p %d\r\n", err);
+		sendReply(ctx, reply);
+		rejectProblem(ctx, ACK_INVALID);
 		return;
 	}
-	led_strip_update_rgb(strip, pixels, STRIP_LENGTH);
+	publishProblem(ctx);
+}
+
+static void sendLibraryResult(input_context_t *ctx, char op, int rc)
+{
+	char reply[24];
+	snprintf(reply, sizeof(reply), "lib %c %d\r\n", op, rc);
+	sendReply(ctx, reply);
+}
+
+// The reply to a begin frame waits until the old library has been erased
+static void libraryErased(int err, void *arg)
+{
+	sendLibraryResult(arg, LIB_OP_BEGIN, err);
+}
+
+static void runLibraryCommand(input_context_t *ctx)
+{
+	int rc;
+	switch (ctx->libOp)
+	{
+	case LIB_OP_BEGIN:
+		rc = ctx->libLen == 4 ? problem_library_begin(sys_get_be32(ctx->libPayload), libraryErased, ctx) : -EINVAL;
+		if (rc == 0)
+		{
+			return;
+		}
+		break;
+	case LIB_OP_WRITE:
+		rc = ctx->libLen >= 4 ? problem_library_write(sys_get_be32(ctx->libPayload), &ctx->libPayload[4], ctx->libLen - 4) : -EINVAL;
+		break;
+	case LIB_OP_FINISH:
+		rc = problem_library_finish();
+		break;
+	default:
+		rc = -ENOTSUP;
+		break;
+	}
+	sendLibraryResult(ctx, ctx->libOp, rc);
 }
 
-void handleChar(char c)
+// Handles a byte of a library upload frame. Returns false if the frame is invalid.
+static bool handleLibraryByte(input_context_t *ctx, uint8_t b)
 {
-	LOG_DBG("%s(%c) - state %d", __func__, c, parse_state);
-	switch (parse_state)
+	if (ctx->parse_state != PARSE_LIB_CRC)
+	{
+		ctx->binCRC = crc16_ccitt(ctx->binCRC, &b, 1);
+	}
+	switch (ctx->parse_state)
+	{
+	case PARSE_LIB_OP:
+		ctx->libOp = b;
+		ctx->parse_state = PARSE_LIB_LEN;
+		return true;
+	case PARSE_LIB_LEN:
+		ctx->libLen = b;
+		ctx->libReceived = 0;
+		ctx->binBytesLeft = 2;
+		ctx->binValue = 0;
+		ctx->parse_state = b ? PARSE_LIB_DATA : PARSE_LIB_CRC;
+		return true;
+	case PARSE_LIB_DATA:
+		ctx->libPayload[ctx->libReceived++] = b;
+		if (ctx->libReceived == ctx->libLen)
+		{
+			ctx->parse_state = PARSE_LIB_CRC;
+		}
+		return true;
+	case PARSE_LIB_CRC:
+		ctx->binValue = (ctx->binValue << 8) | b;
+		if (--ctx->binBytesLeft > 0)
+		{
+			return true;
+		}
+		if (ctx->binValue != ctx->binCRC)
+		{
+			return false;
+		}
+		ctx->parse_state = PARSE_START;
+		runLibraryCommand(ctx);
+		return true;
+	default:
+		return false;
+	}
+}
+#endif
+
+void handleChar(input_context_t *ctx, char c)
+{
+	if (TRACE_VERBOSE(TRACE_VERBOSITY_BYTES))
+	{
+		LOG_DBG("%s(%c) - state %d", __func__, c, ctx->parse_state);
+	}
+	switch (ctx->parse_state)
 	{
 	case PARSE_START:
-		bAdditionalLEDs = false;
-		parseBuffer[0] = '\0';
-		parseBufferPos = 0;
 		switch (c)
 		{
 		case '~':
-			bApplyLEDMapping = true;
-			bTestMode = false;
-			parse_state = PARSE_CONFIG;
+			ctx->bTestMode = false;
+			startProblem(ctx, true, false);
+			ctx->parse_state = PARSE_CONFIG;
 			return;
 		case 'L':
 		case 'l':
-			bApplyLEDMapping = true;
-			bTestMode = false;
-			parse_state = PARSE_PROB_START;
+			ctx->bTestMode = false;
+			startProblem(ctx, true, false);
+			ctx->parse_state = PARSE_PROB_START;
 			return;
 		case 't':
 		case 'T':
-			bApplyLEDMapping = true;
-			bTestMode = true;
-			parse_state = PARSE_HOLDS;
+			ctx->bTestMode = true;
+			startProblem(ctx, true, false);
+			ctx->parse_state = PARSE_HOLDS;
 			return;
 		case 'x':
 		case 'X':
-			bTestMode = true;
-			bApplyLEDMapping = false;
-			parse_state = PARSE_HOLDS;
+			ctx->bTestMode = true;
+			startProblem(ctx, false, false);
+			ctx->parse_state = PARSE_HOLDS;
 			return;
 		case 'a':
 		case 'A':
-			bTestMode = true;
-			bApplyLEDMapping = true;
-			bAdditionalLEDs = true;
-			parse_state = PARSE_HOLDS;
+			ctx->bTestMode = true;
+			startProblem(ctx, true, true);
+			ctx->parse_state = PARSE_HOLDS;
 			return;
 		case 'r':
 		case 'R':
-			k_work_submit(&randomPatternWork);
+			led_pattern_start_random();
+			return;
+		case 'f':
+		case 'F':
+		{
+			char reply[48];
+			snprintf(reply, sizeof(reply), "frames %u/%u/%u\r\n", led_pattern_stats.framesShown,
+					 led_pattern_stats.framesLate, led_pattern_stats.framesDropped);
+			sendReply(ctx, reply);
+			return;
+		}
+		case 'o':
+		case 'O':
+		{
+			strip_power_stats_t stats;
+			strip_power_get_stats(&stats);
+			char reply[64];
+			snprintf(reply, sizeof(reply), "power %llu/%llu/%llu %u\r\n",
+					 (unsigned long long)stats.stateMs[STRIP_POWER_LIT], (unsigned long long)stats.stateMs[STRIP_POWER_DARK],
+					 (unsigned long long)stats.stateMs[STRIP_POWER_OFF], stats.switchOns);
+			sendReply(ctx, reply);
+			return;
+		}
+#ifdef CONFIG_ZBOARD_BLE_LINK
+		case 'i':
+		case 'I':
+			sendLinkInfo(ctx);
+			return;
+#endif
+		case '?':
+			sendReply(ctx, "zboard text bin1" PROTOCOL_LIBRARY PROTOCOL_PLAYLIST PROTOCOL_ACKS "\r\n");
+			return;
+#ifdef CONFIG_ZBOARD_PROBLEM_LIBRARY
+		case 'p':
+		case 'P':
+			ctx->libraryId = 0;
+			ctx->holdDigits = 0;
+			ctx->parse_state = PARSE_LIB_SHOW;
+			return;
+		case (char)LIB_FRAME_START:
+			ctx->binCRC = 0xFFFF;
+			ctx->parse_state = PARSE_LIB_OP;
+			return;
+#endif
+#ifdef CONFIG_ZBOARD_PROBLEM_CACHE
+		case 'c':
+		case 'C':
+		{
+			char reply[32];
+			snprintf(reply, sizeof(reply), "cache %u/%u\r\n", problem_cache_stats.hits, problem_cache_stats.misses);
+			sendReply(ctx, reply);
+			return;
+		}
+#endif
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+		case 's':
+		case 'S':
+			sendLatencyStats(ctx);
+			return;
+#endif
+#ifdef CONFIG_ZBOARD_TRACE
+		case 'd':
+		case 'D':
+			sendTrace(ctx);
+			return;
+		case 'v':
+		case 'V':
+			ctx->parse_state = PARSE_VERBOSITY;
+			return;
+#endif
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+		case 'n':
+		case 'N':
+			ctx->parse_state = PARSE_ACKS;
+			return;
+#endif
+#ifdef CONFIG_ZBOARD_PLAYLIST
+		case 'u':
+		case 'U':
+			ctx->holdNum = 0;
+			ctx->holdDigits = 0;
+			ctx->parse_state = PARSE_PLAYLIST;
+			return;
+		case '>':
+			stepPlaylist(ctx, 1);
+			return;
+		case '<':
+			stepPlaylist(ctx, -1);
+			return;
+#endif
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+		case 'k':
+		case 'K':
+			ctx->paletteToken = 0;
+			ctx->holdNum = 0;
+			ctx->holdDigits = 0;
+			ctx->parse_state = PARSE_PALETTE;
+			return;
+#endif
+		case (char)BIN_FRAME_START:
+			ctx->binCRC = 0xFFFF;
+			ctx->parse_state = PARSE_BIN_FLAGS;
+			return;
+		case 'b':
+		case 'B':
+			ctx->holdNum = 0;
+			ctx->holdDigits = 0;
+			ctx->parse_state = PARSE_LAYOUT;
+			return;
+		case 'w':
+		case 'W':
+			memset(&ctx->parseWiring, 0, sizeof(ctx->parseWiring));
+			ctx->wiringToken = 0;
+			ctx->wiringFlags = 0;
+			ctx->holdNum = 0;
+			ctx->holdDigits = 0;
+			ctx->parse_state = PARSE_WIRING;
 			return;
 		}
 		break;
@@ -131,12 +994,12 @@ void handleChar(char c)
 		switch (c)
 		{
 		case 'D':
-			bAdditionalLEDs = true;
-			parse_state = PARSE_PROB_START;
+			ctx->parsingProblem->bAdditionalLEDs = true;
+			ctx->parse_state = PARSE_PROB_START;
 			return;
 
 		case 'l':
-			parse_state = PARSE_PROB_START;
+			ctx->parse_state = PARSE_PROB_START;
 			return;
 		}
 		break;
@@ -144,30 +1007,185 @@ void handleChar(char c)
 	case PARSE_PROB_START:
 		if (c == '#')
 		{
-			parse_state = PARSE_HOLDS;
+			ctx->parse_state = PARSE_HOLDS;
 			return;
 		}
 		break;
 
 	case PARSE_HOLDS:
-		if (c == '#')
+		// Each <holdspec> is decoded as it arrives, so there is nothing left to parse when the final '#' comes in
+		if (c >= '0' && c <= '9')
 		{
-			LOG_DBG("Received complete problem");
-			parseBuffer[parseBufferPos] = '\0';
-			strncpy(strProblem, parseBuffer, sizeof(strProblem));
-			k_work_submit(&renderProblemWork);
-			bProbPending = true;
-			parse_state = PARSE_START;
+			if (ctx->holdNum <= HOLD_NUM_MAX) // Stop accumulating once it's out of range so it can't wrap around
+			{
+				ctx->holdNum = ctx->holdNum * 10 + (c - '0');
+			}
+			ctx->holdDigits++;
 			return;
 		}
-		parseBuffer[parseBufferPos++] = c;
-		if (parseBufferPos >= sizeof(parseBuffer) - 1)
+		if (c == ',' || c == '#')
 		{
-			LOG_ERR("Problem string overflow");
-			parse_state = PARSE_START;
+			if (!finishHold(ctx))
+			{
+				LOG_ERR("Problem hold list overflow");
+				rejectProblem(ctx, ACK_OVERFLOW);
+				// The rest of the hold list isn't parsed as commands
+				ctx->parse_state = c == '#' ? PARSE_START : PARSE_SKIP_HOLDS;
+				return;
+			}
+			if (c == '#')
+			{
+				LOG_DBG("Received complete problem");
+				publishProblem(ctx);
+				ctx->parse_state = PARSE_START;
+				return;
+			}
+			startHold(ctx);
+			return;
+		}
+		if (!ctx->bTestMode && ctx->holdDigits == 0)
+		{
+			ctx->holdType = holdTypeFromChar(c); // Hold descriptions consist of a hold type (S, P, E, etc.) followed by a hold number
 		}
 		return;
 		break;
+
+	case PARSE_SKIP_HOLDS:
+		if (c == '#')
+		{
+			ctx->parse_state = PARSE_START;
+		}
+		return;
+
+	case PARSE_WIRING:
+		if (!handleWiringChar(ctx, c))
+		{
+			LOG_ERR("Invalid wiring configuration");
+			ctx->parse_state = PARSE_START;
+		}
+		return;
+
+#ifdef CONFIG_ZBOARD_PLAYLIST
+	case PARSE_PLAYLIST:
+		if (c >= '0' && c <= '9' && ctx->holdDigits < 3)
+		{
+			ctx->holdNum = ctx->holdNum * 10 + (c - '0');
+			ctx->holdDigits++;
+			return;
+		}
+		if (c == '#')
+		{
+			startPlaylist(ctx);
+		}
+		else
+		{
+			LOG_ERR("Invalid playlist command");
+		}
+		ctx->parse_state = PARSE_START;
+		return;
+#endif
+
+	case PARSE_LAYOUT:
+		if (c >= '0' && c <= '9' && ctx->holdDigits < 3)
+		{
+			ctx->holdNum = ctx->holdNum * 10 + (c - '0');
+			ctx->holdDigits++;
+			return;
+		}
+		if (c == '#')
+		{
+			applyLayout(ctx);
+		}
+		else
+		{
+			LOG_ERR("Invalid layout command");
+		}
+		ctx->parse_state = PARSE_START;
+		return;
+
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+	case PARSE_PALETTE:
+		if (!handlePaletteChar(ctx, c))
+		{
+			LOG_ERR("Invalid palette command");
+			ctx->parse_state = PARSE_START;
+		}
+		return;
+#endif
+
+	case PARSE_BIN_FLAGS:
+	case PARSE_BIN_COUNT:
+	case PARSE_BIN_HOLDS:
+	case PARSE_BIN_CRC:
+	{
+		int err = handleBinaryByte(ctx, c);
+		if (err)
+		{
+			LOG_ERR("Invalid binary problem frame: %d", err);
+			rejectProblem(ctx, err == -E2BIG ? ACK_OVERFLOW : ACK_INVALID);
+			ctx->parse_state = PARSE_START;
+		}
+		return;
+	}
+
+#ifdef CONFIG_ZBOARD_PROBLEM_LIBRARY
+	case PARSE_LIB_SHOW:
+		if (c >= '0' && c <= '9' && ctx->holdDigits < 9) // IDs up to 999999999 so they can't overflow
+		{
+			ctx->libraryId = ctx->libraryId * 10 + (c - '0');
+			ctx->holdDigits++;
+			return;
+		}
+		if (c == '#' && ctx->holdDigits > 0)
+		{
+			showLibraryProblem(ctx);
+			ctx->parse_state = PARSE_START;
+			return;
+		}
+		LOG_ERR("Invalid library problem ID");
+		ctx->parse_state = PARSE_START;
+		return;
+
+	case PARSE_LIB_OP:
+	case PARSE_LIB_LEN:
+	case PARSE_LIB_DATA:
+	case PARSE_LIB_CRC:
+		if (!handleLibraryByte(ctx, c))
+		{
+			LOG_ERR("Invalid library frame");
+			ctx->parse_state = PARSE_START;
+		}
+		return;
+#endif
+
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+	case PARSE_ACKS:
+		if (c == '0' || c == '1')
+		{
+			ctx->bAcks = (c == '1');
+			ctx->ackSeq = 0;
+		}
+		else
+		{
+			LOG_ERR("Invalid ack command");
+		}
+		ctx->parse_state = PARSE_START;
+		return;
+#endif
+
+#ifdef CONFIG_ZBOARD_TRACE
+	case PARSE_VERBOSITY:
+		if (c >= '0' && c <= '0' + TRACE_VERBOSITY_BYTES)
+		{
+			trace_verbosity = c - '0';
+		}
+		else
+		{
+			LOG_ERR("Invalid verbosity level");
+		}
+		ctx->parse_state = PARSE_START;
+		return;
+#endif
 	}
 }
 
@@ -177,6 +1195,12 @@ static void bt_handle_connected(struct bt_conn *conn, uint8_t err)
 	{
 		LOG_ERR("Conn failed, err 0x%02x %s\n", err, bt_hci_err_to_str(err));
 	}
+	else
+	{
+		k_spinlock_key_t key = k_spin_lock(&connLock);
+		inputs[bt_conn_index(conn)].conn = bt_conn_ref(conn);
+		k_spin_unlock(&connLock, key);
+	}
 	// Restart advertising so that multiple clients can connect
 	int rc = bt_le_adv_start(BT_LE_ADV_CONN_FAST_1, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
 	if (!err)
@@ -199,8 +1223,41 @@ static void bt_handle_connected(struct bt_conn *conn, uint8_t err)
 static void bt_handle_disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	LOG_INF("Disconnected, reason 0x%02x %s\n", reason, bt_hci_err_to_str(reason));
+	input_context_t *ctx = &inputs[bt_conn_index(conn)];
+	k_spinlock_key_t key = k_spin_lock(&connLock);
+	struct bt_conn *old = ctx->conn;
+	ctx->conn = NULL;
+	k_spin_unlock(&connLock, key);
+	if (old)
+	{
+		bt_conn_unref(old); // A reply being sent holds its own reference
+	}
+	rx_ring_mark_break(&ctx->ring); // The next client to get this connection slot starts afresh
+	k_work_submit(&drainInputWork); // So the parser resets now, e.g. to give up a playlist upload it owned
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+	ctx->bAcks = false;
+#endif
+}
+
+// Data written to the NUS RX characteristic by any client. Runs in the Bluetooth RX thread.
+static void nus_received(struct bt_conn *conn, const void *data, uint16_t len, void *user_data)
+{
+	input_context_t *ctx = &inputs[bt_conn_index(conn)];
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+	ctx->rxCycles = k_cycle_get_32();
+#endif
+	rx_ring_put(&ctx->ring, data, len);
+	TRACE_EVENT(TRACE_RX, ctx - inputs, len);
+	k_work_submit(&drainInputWork);
+#ifdef CONFIG_ZBOARD_BLE_LINK
+	ble_link_activity(conn);
+#endif
 }
 
+static struct bt_nus_cb nus_listener = {
+	.received = nus_received,
+};
+
 // A client has dropped and we have a free connection object again, so we can start advertising if we weren't already
 static void bt_handle_recycled(void)
 {
@@ -220,83 +1277,217 @@ static struct bt_conn_cb bt_conn_cb_zboard = {
 	.disconnected = bt_handle_disconnected,
 	.recycled = bt_handle_recycled};
 
-void renderProblem(struct k_work *work)
+// Adds the stages of showing the problem to the latency histograms once the frame has been handed to the strip
+static void recordLatency(const problem_t *prob, uint32_t startCycles, uint32_t composedCycles)
 {
-	clearStrip(true);
-	LOG_INF("Problem string: %s", strProblem);
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+	uint32_t sentCycles = k_cycle_get_32();
+	latency_stats_record(LATENCY_PARSE, prob->rxCycles, prob->completeCycles);
+	latency_stats_record(LATENCY_QUEUE, prob->completeCycles, startCycles);
+	latency_stats_record(LATENCY_COMPOSE, startCycles, composedCycles);
+	latency_stats_record(LATENCY_SEND, composedCycles, sentCycles);
+	latency_stats_record(LATENCY_TOTAL, prob->rxCycles, sentCycles);
+#endif
+}
 
-	strncpy(strProblemBackup, strProblem, sizeof(strProblemBackup) - 1); // store copy of problem string
-	strProblemBackup[sizeof(strProblemBackup) - 1] = '\0';
+static bool holdInRange(const problem_t *prob, uint16_t hold)
+{
+	return HOLD_NUM(hold) < (prob->bApplyLEDMapping ? NUM_PIXELS : STRIP_LENGTH);
+}
 
-	char *token = strtok(strProblem, ",");
+// Draws the problem's holds and the LEDs above them into a frame. Returns the number of holds lit.
+static int composeProblem(const problem_t *prob, problem_frame_t *frame)
+{
+	layer_frame_clear(&frame->holds);
+	layer_frame_clear(&frame->markers);
 	int ledCount = 0;
-	uint16_t ledNum;
-	while (token)
+	for (int i = 0; i < prob->numHolds; i++)
 	{
+		hold_type_t type = HOLD_TYPE(prob->holds[i]);
+		uint16_t moonNum = HOLD_NUM(prob->holds[i]);
+		if (!holdInRange(prob, prob->holds[i]))
+		{
+			TRACE_EVENT(TRACE_HOLD_OUT_OF_RANGE, prob->holds[i], 0);
+			LOG_WRN("Hold %c%d is out of range", hold_type_chars[type], moonNum);
+			continue;
+		}
 		ledCount++;
-		char holdType = bTestMode ? 'P' : token[0];			 // Hold descriptions consist of a hold type (S, P, E) (omitted in test mode)...
-		int moonNum = atoi(bTestMode ? token : (token + 1)); // ... and a hold number
-		uint16_t mapNum = moonNumToMapNum(moonNum);
-		ledNum = bApplyLEDMapping ? led_map[mapNum] : moonNum;
-		const color_t *led_color = &COLOR_BLACK;
-		switch (holdType)
+		uint16_t ledNum = prob->bApplyLEDMapping ? led_map_moon[moonNum] : moonNum;
+		const color_t *led_color = hold_colors[type];
+		layer_frame_set(&frame->holds, ledNum, led_color);
+		TRACE_EVENT(TRACE_HOLD, prob->holds[i], ledNum);
+		if (TRACE_VERBOSE(TRACE_VERBOSITY_HOLDS))
 		{
-		case 'S':
-		case 's':
-			led_color = &COLOR_GREEN;
-			break;
-		case 'R':
-		case 'r':
-		case 'P':
-		case 'p':
-			led_color = &COLOR_BLUE;
-			break;
-		case 'E':
-		case 'e':
-			led_color = &COLOR_RED;
-			break;
-		case 'L':
-		case 'l':
-			led_color = &COLOR_VIOLET;
-			break;
-		case 'M':
-		case 'm':
-			led_color = &COLOR_PINK;
-			break;
-		case 'F':
-		case 'f':
-			led_color = &COLOR_CYAN;
-			break;
+			LOG_INF("%c%d --> %d (%s)", hold_type_chars[type], moonNum, ledNum, led_color->name);
 		}
-		pixels[ledNum] = led_color->rgb;
-		LOG_INF("%c%d --> %d (%s)", holdType, moonNum, ledNum, led_color->name);
 
-		if (bAdditionalLEDs)
+		if (prob->bAdditionalLEDs)
 		{
-			if (mapNum % NUM_ROWS != NUM_ROWS - 1) // Not in the top row
+			// If we're not using the LED mapping, just get the next LED
+			uint16_t ledAboveNum = prob->bApplyLEDMapping ? led_map_moon_above[moonNum] : ledNum + 1;
+			if (ledAboveNum < STRIP_LENGTH) // LED_MAP_NONE if the hold is in the top row
 			{
-				// If we're not using the LED mapping, just get the next LED
-				uint16_t ledAboveNum = bApplyLEDMapping ? led_map[mapNum + 1] : ledNum + 1;
-				pixels[ledAboveNum] = COLOR_YELLOW.rgb;
-				LOG_INF("add. %d", ledAboveNum);
+				layer_frame_set(&frame->markers, ledAboveNum, &COLOR_YELLOW);
+				TRACE_EVENT(TRACE_HOLD_ADDITIONAL, prob->holds[i], ledAboveNum);
+				if (TRACE_VERBOSE(TRACE_VERBOSITY_HOLDS))
+				{
+					LOG_INF("add. %d", ledAboveNum);
+				}
 			}
-			else
+			else if (TRACE_VERBOSE(TRACE_VERBOSITY_HOLDS))
 			{
 				LOG_DBG("LED %d is in the top row, skipping additional LED", ledNum);
 			}
 		}
-		token = strtok(NULL, ",");
 	}
-	int err = led_strip_update_rgb(strip, pixels, STRIP_LENGTH);
+	return ledCount;
+}
+
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+// Acks of rendered problems, waiting for sendRenderedAcks() to send them from the system workqueue. Clients
+// that use acks send a problem at a time, so only a burst from clients that don't can fill it.
+#define ACK_QUEUE_DEPTH 8
+
+typedef struct renderedAck
+{
+	uint8_t source;
+	uint16_t seq;
+	ack_status_t status;
+	uint32_t renderUs;
+} rendered_ack_t;
+
+static rendered_ack_t renderedAcks[ACK_QUEUE_DEPTH];
+static int numRenderedAcks;
+static struct k_spinlock ackLock; // Protects renderedAcks and numRenderedAcks
+static struct k_work sendAcksWork;
+
+static void sendRenderedAcks(struct k_work *work)
+{
+	for (;;)
+	{
+		k_spinlock_key_t key = k_spin_lock(&ackLock);
+		if (numRenderedAcks == 0)
+		{
+			k_spin_unlock(&ackLock, key);
+			return;
+		}
+		rendered_ack_t ack = renderedAcks[0];
+		memmove(&renderedAcks[0], &renderedAcks[1], (ACK_QUEUE_DEPTH - 1) * sizeof(renderedAcks[0]));
+		numRenderedAcks--;
+		k_spin_unlock(&ackLock, key);
+		sendAck(&inputs[ack.source], ack.seq, ack.status, ack.renderUs);
+	}
+}
+#endif
+
+// Acks the problem that has just been sent to the strip, with the time since rendering started. Runs on the
+// render workqueue, so the ack is only queued here.
+static void ackRendered(const problem_t *prob, uint32_t startCycles, int err)
+{
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+	if (!inputs[prob->source].bAcks)
+	{
+		return;
+	}
+	ack_status_t status = err ? ACK_FAILED : ACK_OK;
+	for (int i = 0; i < prob->numHolds && status == ACK_OK; i++)
+	{
+		if (!holdInRange(prob, prob->holds[i]))
+		{
+			status = ACK_BAD_HOLD;
+		}
+	}
+	rendered_ack_t ack = {
+		.source = prob->source,
+		.seq = prob->seq,
+		.status = status,
+		.renderUs = k_cyc_to_us_floor32(k_cycle_get_32() - startCycles),
+	};
+	k_spinlock_key_t key = k_spin_lock(&ackLock);
+	bool bQueued = numRenderedAcks < ACK_QUEUE_DEPTH;
+	if (bQueued)
+	{
+		renderedAcks[numRenderedAcks++] = ack;
+	}
+	k_spin_unlock(&ackLock, key);
+	if (bQueued)
+	{
+		k_work_submit(&sendAcksWork);
+	}
+	else
+	{
+		LOG_WRN("Ack %u to client %d dropped", ack.seq, ack.source);
+	}
+#endif
+}
+
+void renderProblem(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&problemLock);
+	if (numPending == 0)
+	{
+		k_spin_unlock(&problemLock, key);
+		return;
+	}
+	problem_t *next = pendingProblems[0];
+	memmove(&pendingProblems[0], &pendingProblems[1], (QUEUE_DEPTH - 1) * sizeof(pendingProblems[0]));
+	numPending--;
+	freeProblems[QUEUE_DEPTH - 1 - numPending] = renderingProblem;
+	renderingProblem = next;
+	bool bMorePending = numPending > 0;
+	k_spin_unlock(&problemLock, key);
+	if (bMorePending)
+	{
+		led_output_submit(&renderProblemWork); // Queued problems are rendered one per run
+	}
+
+	const problem_t *prob = renderingProblem;
+	uint32_t startCycles = k_cycle_get_32();
+	TRACE_EVENT(TRACE_RENDER_START, prob->numHolds, 0);
+	if (TRACE_VERBOSE(TRACE_VERBOSITY_HOLDS))
+	{
+		LOG_INF("Problem with %d holds", prob->numHolds);
+	}
+#ifdef CONFIG_ZBOARD_PROBLEM_CACHE
+	uint32_t hash = problem_cache_hash(prob);
+	const problem_frame_t *cached = problem_cache_lookup(prob, hash);
+	if (cached)
+	{
+		uint32_t composedCycles = k_cycle_get_32();
+		int err = compositor_show_problem(cached); // Sends nothing if the problem is already showing
+		recordLatency(prob, startCycles, composedCycles);
+		ackRendered(prob, startCycles, err);
+		TRACE_EVENT(TRACE_CACHE_HIT, 0, hash);
+		if (err)
+		{
+			LOG_ERR("Failed to update LED strip: %d", err);
+		}
+		else if (TRACE_VERBOSE(TRACE_VERBOSITY_HOLDS))
+		{
+			LOG_INF("Rendered problem from cache");
+		}
+		return;
+	}
+#endif
+
+	static problem_frame_t composed; // Only used on the render workqueue
+	int ledCount = composeProblem(prob, &composed);
+#ifdef CONFIG_ZBOARD_PROBLEM_CACHE
+	problem_cache_store(prob, hash, &composed);
+#endif
+	uint32_t composedCycles = k_cycle_get_32();
+	int err = compositor_show_problem(&composed);
+	recordLatency(prob, startCycles, composedCycles);
+	ackRendered(prob, startCycles, err);
+	TRACE_EVENT(TRACE_RENDER_DONE, ledCount, err);
 	if (err)
 	{
 		LOG_ERR("Failed to update LED strip: %d", err);
 	}
-	else
+	else if (TRACE_VERBOSE(TRACE_VERBOSITY_HOLDS))
 	{
 		LOG_INF("Rendered problem with %d LEDs", ledCount);
 	}
-	bProbPending = false;
 }
 
 void input_cb(const struct device *dev, void *user_data)
@@ -311,26 +1502,136 @@ void input_cb(const struct device *dev, void *user_data)
 		return;
 	}
 
-	k_work_submit(&drainUARTWork);
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+	inputs[INPUT_UART].rxCycles = k_cycle_get_32();
+#endif
+	size_t len = rx_ring_fill(&inputs[INPUT_UART].ring, uart_in);
+	TRACE_EVENT(TRACE_RX, INPUT_UART, len);
+	k_work_submit(&drainInputWork); // Does nothing if it's already pending, however many interrupts come in
+}
+
+// Parses everything in an input's receive ring, a span at a time
+static void drainRing(input_context_t *ctx)
+{
+	for (;;)
+	{
+		const uint8_t *data;
+		size_t len = rx_ring_peek(&ctx->ring, &data);
+		for (size_t i = 0; i < len; i++)
+		{
+			handleChar(ctx, data[i]);
+		}
+		if (rx_ring_consume(&ctx->ring, len))
+		{
+			TRACE_EVENT(TRACE_RX_BREAK, ctx - inputs, ctx->ring.stats.bytesDropped);
+			LOG_WRN("Input %d broken off, %u bytes dropped so far", (int)(ctx - inputs), ctx->ring.stats.bytesDropped);
+			ctx->parse_state = PARSE_START; // Whatever was being parsed is incomplete
+#ifdef CONFIG_ZBOARD_PLAYLIST
+			if (ctx == playlistOwner) // The rest of its upload is lost, e.g. the client disconnected
+			{
+				endPlaylistUpload();
+			}
+#endif
+		}
+		else if (len == 0)
+		{
+			return;
+		}
+	}
+}
+
+void drainInput(struct k_work *work)
+{
+	for (int i = 0; i < NUM_INPUTS; i++)
+	{
+		drainRing(&inputs[i]);
+	}
+}
+
+int inputs_init(void)
+{
+	for (int i = 0; i < NUM_INPUTS; i++)
+	{
+		inputs[i].parse_state = PARSE_START;
+		inputs[i].parsingProblem = &problemBuffers[i];
+		k_mutex_init(&inputs[i].replyLock);
+	}
+	for (int i = 0; i < QUEUE_DEPTH; i++)
+	{
+		freeProblems[i] = &problemBuffers[NUM_INPUTS + i];
+	}
+	k_work_init(&drainInputWork, drainInput);
+	k_work_init(&renderProblemWork, renderProblem);
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+	k_work_init(&sendAcksWork, sendRenderedAcks);
+#endif
+#ifdef CONFIG_ZBOARD_PLAYLIST
+	playlist_init(composeProblem);
+#endif
+
+	// Connections are tracked from the start so that each one's input goes to its own context
+	int err = bt_conn_cb_register(&bt_conn_cb_zboard);
+	if (err)
+	{
+		LOG_ERR("Failed to register BT conn callback: %d", err);
+		return err;
+	}
+#ifdef CONFIG_ZBOARD_BLE_LINK
+	err = ble_link_init();
+	if (err)
+	{
+		LOG_ERR("Failed to register BT link callbacks: %d", err);
+		return err;
+	}
+#endif
+
+	err = bt_nus_cb_register(&nus_listener, NULL);
+	if (err)
+	{
+		LOG_ERR("Failed to register NUS callback: %d", err);
+	}
+	return err;
 }
 
-void drainUART(struct k_work *work)
+// Adds up the receive ring statistics of every input
+void inputs_get_stats(rx_ring_stats_t *total)
 {
-	uint8_t c;
-	/* read until FIFO empty */
-	while (uart_fifo_read(uart_in, &c, 1) == 1)
+	memset(total, 0, sizeof(*total));
+	for (int i = 0; i < NUM_INPUTS; i++)
 	{
-		handleChar(c);
+		const rx_ring_stats_t *stats = &inputs[i].ring.stats;
+		total->bytesIn += stats->bytesIn;
+		total->overruns += stats->overruns;
+		total->bytesDropped += stats->bytesDropped;
+		total->highWater = MAX(total->highWater, stats->highWater);
 	}
 }
 
 int main(void)
 {
-	k_work_init(&drainUARTWork, drainUART);
-	k_work_init(&randomPatternWork, show_random_pattern);
-	k_work_init(&renderProblemWork, renderProblem);
+	int err = inputs_init();
+	if (err)
+	{
+		return err;
+	}
+	led_patterns_init();
 
-	initialize_led_map();
+	led_map_init(STRIP_LENGTH);
+	if (IS_ENABLED(CONFIG_SETTINGS))
+	{
+		int rc = settings_subsys_init();
+		if (rc)
+		{
+			LOG_ERR("Failed to initialise settings: %d", rc);
+		}
+		else
+		{
+			settings_load(); // Restores a wiring saved with the 'w' command
+		}
+	}
+#ifdef CONFIG_ZBOARD_PROBLEM_LIBRARY
+	problem_library_init();
+#endif
 
 	if (device_is_ready(strip))
 	{
@@ -341,8 +1642,11 @@ int main(void)
 		LOG_ERR("LED strip device %s is not ready", strip->name);
 		return 0;
 	}
-
-	int err;
+	compositor_init();
+	if (led_output_init())
+	{
+		return 0;
+	}
 
 	if (!device_is_ready(uart_in))
 	{
@@ -379,13 +1683,6 @@ int main(void)
 		return err;
 	}
 
-	err = bt_conn_cb_register(&bt_conn_cb_zboard);
-	if (err)
-	{
-		LOG_ERR("Failed to register BT conn callback: %d", err);
-		return err;
-	}
-
 	err = bt_le_adv_start(BT_LE_ADV_CONN_FAST_1, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
 	if (err)
 	{
@@ -395,15 +1692,9 @@ int main(void)
 
 	LOG_INF("Bluetooth setup complete, advertising as '%s'", DEVICE_NAME);
 
-	led_startup_pattern();
-	clearStrip(true);
-
-	while (1)
-	{
-		// Since receiving characters is handled by interrupts ( see input_cb() ), and
-		// task scheduling is handled by the kernel, we just need to sleep and let the system work.
-		k_sleep(K_MSEC(100));
-	}
+	led_pattern_start(&led_startup_pattern); // Runs in the background and clears its layer when it's done
 
+	// Everything from here on is driven by interrupts (see input_cb() and the NUS callbacks), timers and work
+	// items, so the main thread can end and leave the CPU idle until the next event
 	return 0;
 }
@@ -6,35 +6,43 @@
 #include <zephyr/drivers/led_strip.h>
 #include <zephyr/logging/log.h>
 
-// These #defines must occur before including led_map.h since they control the wiring configuration that the LED mapping code needs to know about
-
-// Wiring must be zig-zag fashion up and down the columns.
-// By default, we have the first LED at the top of the first column, and the columns go left to right
-// The following defines can modify this
-#define WIRING_FIRST_LED_RIGHT // Columns goes right to left instead
-// #define WIRING_FIRST_LED_BOTTOM		1	// First LED is at the bottom of the first column instead of the top
-//  If some LEDs need to be skipped because there is a beam or other obstruction that you need to go around/over,
-//  you can control that here.You need to specify the LED numbers that will be skipped in the first column and the code
-//  will assume the other columns are identical.
-//  For example, if you have a beam between the 6th and 7th row, and another between the 12th and 13th row, and you need
-//  to skip 2 LEDs for each beam, you'd specify 6,7,14,15 so that LEDs 0-5, 8-13, 16-21 are used for the first column
-#define WIRING_LEDS_SKIP_FIRST_COLUMN 6, 7, 14, 15
-
 #include "led_map.h"
+#include "rx_ring.h"
 
+// The strip can be split into up to four segments, each driven by its own led_strip device: the led-strip
+// alias, then led-strip-1 to led-strip-3 if they exist. LED numbers run through the segments in that order,
+// so with whole columns on each segment, each drives a range of columns (see led_output.h).
 #if DT_NODE_HAS_PROP(DT_ALIAS(led_strip), chain_length)
-#define STRIP_LENGTH DT_PROP(DT_ALIAS(led_strip), chain_length)
+#define STRIP_SEGMENT_0_LENGTH DT_PROP(DT_ALIAS(led_strip), chain_length)
 #else
 #error Unable to determine length of LED strip
 #endif
+#if DT_HAS_ALIAS(led_strip_1)
+#define STRIP_SEGMENT_1_LENGTH DT_PROP(DT_ALIAS(led_strip_1), chain_length)
+#else
+#define STRIP_SEGMENT_1_LENGTH 0
+#endif
+#if DT_HAS_ALIAS(led_strip_2)
+#define STRIP_SEGMENT_2_LENGTH DT_PROP(DT_ALIAS(led_strip_2), chain_length)
+#else
+#define STRIP_SEGMENT_2_LENGTH 0
+#endif
+#if DT_HAS_ALIAS(led_strip_3)
+#define STRIP_SEGMENT_3_LENGTH DT_PROP(DT_ALIAS(led_strip_3), chain_length)
+#else
+#define STRIP_SEGMENT_3_LENGTH 0
+#endif
+#define NUM_STRIP_SEGMENTS (1 + DT_HAS_ALIAS(led_strip_1) + DT_HAS_ALIAS(led_strip_2) + DT_HAS_ALIAS(led_strip_3))
+#define STRIP_LENGTH (STRIP_SEGMENT_0_LENGTH + STRIP_SEGMENT_1_LENGTH + STRIP_SEGMENT_2_LENGTH + STRIP_SEGMENT_3_LENGTH)
 
 #define LED_BRIGHTNESS 64
-#define PROBLEM_STRING_MAX_LENGTH 256
+#define PROBLEM_MAX_HOLDS 64 // Most holds that can be lit by a single problem (including test mode lists)
 
 #define RGB(_r, _g, _b) {.r = (_r), .g = (_g), .b = (_b)}
-#define COLOR(_r, _g, _b, _name) {.rgb = RGB((_r), (_g), (_b)), .name = (_name)}
+#define COLOR(_index, _r, _g, _b, _name) [_index] = {.rgb = RGB((_r), (_g), (_b)), .name = (_name), .index = (_index)}
 
-#define LED_SET_PIXEL(col, row, color) pixels[LED_MAP_COL_ROW((col), (row))] = (color).rgb;
+// Patterns draw on the compositor's animation layer (see compositor.h)
+#define LED_SET_PIXEL(col, row, color) compositor_set(LAYER_ANIMATION, LED_MAP_COL_ROW((col), (row)), &(color));
 
 #define LED_SET_ROW(row, color)              \
     for (int __i = 0; __i < NUM_COLS; __i++) LED_SET_PIXEL(__i, row, color)
@@ -46,6 +54,7 @@ typedef struct colorType
 {
     struct led_rgb rgb;
     const char *name;
+    uint8_t index; // Position in color_list[], which is also its palette index
 } color_t;
 
 typedef enum parseState
@@ -53,22 +62,154 @@ typedef enum parseState
     PARSE_START,
     PARSE_CONFIG,
     PARSE_PROB_START,
-    PARSE_HOLDS
+    PARSE_HOLDS,
+    PARSE_SKIP_HOLDS,
+    PARSE_WIRING,
+    PARSE_BIN_FLAGS,
+    PARSE_BIN_COUNT,
+    PARSE_BIN_HOLDS,
+    PARSE_BIN_CRC,
+    PARSE_LIB_SHOW,
+    PARSE_LIB_OP,
+    PARSE_LIB_LEN,
+    PARSE_LIB_DATA,
+    PARSE_LIB_CRC,
+    PARSE_VERBOSITY,
+    PARSE_PALETTE,
+    PARSE_PLAYLIST,
+    PARSE_LAYOUT,
+    PARSE_ACKS
 } parse_state_t;
 
-extern struct led_rgb pixels[STRIP_LENGTH];
+// What became of a problem, as reported to the client that sent it (see CONFIG_ZBOARD_RENDER_ACKS)
+typedef enum ackStatus
+{
+    ACK_OK,       // shown, or added to the playlist being uploaded
+    ACK_BAD_HOLD, // shown without the holds that are out of range
+    ACK_OVERFLOW, // more than PROBLEM_MAX_HOLDS holds, not shown
+    ACK_INVALID,  // binary frame failed its checks, or library problem not loaded, not shown
+    ACK_FULL,     // no room left in the playlist
+    ACK_DROPPED,  // replaced in the queue by a newer problem before it was shown
+    ACK_FAILED,   // the strip update failed
+    NUM_ACK_STATUSES
+} ack_status_t;
+
+typedef enum holdType
+{
+    HOLD_NONE, // Unrecognised hold type, shown as black
+    HOLD_START,
+    HOLD_PROGRESS,
+    HOLD_END,
+    HOLD_LEFT,
+    HOLD_RIGHT,
+    HOLD_MATCH,
+    HOLD_FOOT,
+    NUM_HOLD_TYPES
+} hold_type_t;
+
+// Holds are stored packed into 16 bits: the hold type in the top 4 bits and the hold number in the rest
+#define HOLD_NUM_BITS 12
+#define HOLD_NUM_MAX ((1 << HOLD_NUM_BITS) - 1)
+#define HOLD_PACK(type, num) ((uint16_t)(((type) << HOLD_NUM_BITS) | ((num) & HOLD_NUM_MAX)))
+#define HOLD_TYPE(hold) ((hold_type_t)((hold) >> HOLD_NUM_BITS))
+#define HOLD_NUM(hold) ((uint16_t)((hold) & HOLD_NUM_MAX))
+
+// Binary problem frames (see the protocol description in zboard.c)
+#define BIN_FRAME_START 0xB5
+#define BIN_FLAG_ADDITIONAL_LEDS 0x01 // Same as the 'D' config of text problems
+#define BIN_FLAG_NO_LED_MAPPING 0x02  // Hold numbers are LED numbers, as in 'x' test mode
+#define BIN_FLAGS_SUPPORTED (BIN_FLAG_ADDITIONAL_LEDS | BIN_FLAG_NO_LED_MAPPING)
+
+// Problem library upload frames (CONFIG_ZBOARD_PROBLEM_LIBRARY)
+#define LIB_FRAME_START 0xB6
+#define LIB_OP_BEGIN 'B'  // <size>: erase the library partition for an upload of <size> bytes
+#define LIB_OP_WRITE 'W'  // <offset> <data>: write a chunk of the library
+#define LIB_OP_FINISH 'E' // check the uploaded library and start using it
+
+typedef struct problem
+{
+    uint16_t holds[PROBLEM_MAX_HOLDS]; // Packed with HOLD_PACK()
+    uint8_t numHolds;
+    bool bAdditionalLEDs;  // Light the LED above each hold as well
+    bool bApplyLEDMapping; // Hold numbers are Moonboard numbers rather than LED numbers
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+    uint32_t rxCycles;       // k_cycle_get_32() when the data arrived
+    uint32_t completeCycles; // k_cycle_get_32() when the last byte was parsed
+#endif
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+    uint8_t source; // Index in inputs[] of the client that sent it
+    uint16_t seq;   // That client's sequence number for it
+#endif
+} problem_t;
+
+#define WIRING_FLAG_HORIZONTAL 0x01 // L or R given
+#define WIRING_FLAG_VERTICAL 0x02   // T or B given
+#define WIRING_FLAGS_COMPLETE (WIRING_FLAG_HORIZONTAL | WIRING_FLAG_VERTICAL)
+
+// Everything the parser keeps for one input: each BLE connection has its own, and so does the UART,
+// so clients sending at the same time can't corrupt each other's problems
+typedef struct inputContext
+{
+    rx_ring_t ring;
+    struct bt_conn *conn; // Connection that replies go to, or NULL for the UART
+    // Held while a reply is sent, or across a reply of several lines, so that replies sent to the client from
+    // other threads can't land in the middle. Taken again by sendReply(), which Zephyr's mutexes allow.
+    struct k_mutex replyLock;
+#ifdef CONFIG_ZBOARD_LATENCY_STATS
+    uint32_t rxCycles; // k_cycle_get_32() when data last arrived
+#endif
+
+    parse_state_t parse_state; // Current state of the problem string parser
+    bool bTestMode;            // Holds are bare numbers with no hold type
+    problem_t *parsingProblem; // Holds are decoded into this as they arrive
+
+    hold_type_t holdType; // Hold currently being parsed
+    uint16_t holdNum;
+    int holdDigits;
+
+    wiring_config_t parseWiring; // Wiring currently being parsed
+    int wiringToken;             // 0 while parsing the flags, then 1 for each skipped LED number
+    int wiringFlags;             // WIRING_FLAG_* bits for the flags seen so far
+
+#ifdef CONFIG_ZBOARD_FRAMEBUFFER_PALETTE
+    int paletteToken;         // Numbers of the palette command parsed so far
+    uint8_t paletteValues[3]; // Palette index, red and green, parsed before blue
+#endif
+
+#ifdef CONFIG_ZBOARD_RENDER_ACKS
+    bool bAcks;      // Client asked for an ack for each problem with n1
+    uint16_t ackSeq; // Sequence number of the last problem received
+#endif
+
+    uint8_t binHoldsLeft; // Holds still to come in the binary frame being parsed
+    uint8_t binBytesLeft; // Bytes still to come in the current hold or CRC
+    uint16_t binCRC;      // CRC of the frame so far
+    uint16_t binValue;    // Hold or CRC being received
+
+#ifdef CONFIG_ZBOARD_PROBLEM_LIBRARY
+    uint32_t libraryId;            // Problem ID being parsed
+    uint8_t libOp;                 // LIB_OP_* of the library frame being parsed
+    uint8_t libLen;                // Payload length of the library frame
+    uint8_t libReceived;           // Payload bytes received so far
+    uint8_t libPayload[UINT8_MAX]; // Payload of the library frame
+#endif
+} input_context_t;
+
+#define INPUT_UART CONFIG_BT_MAX_CONN         // Index of the UART input, after one per connection
+#define NUM_INPUTS (CONFIG_BT_MAX_CONN + 1)
+
 extern const struct device *const strip;
 
 static const color_t color_list[] = {
-    COLOR(LED_BRIGHTNESS, 0x00, 0x00, "red"),
-    COLOR(0x00, LED_BRIGHTNESS, 0x00, "green"),
-    COLOR(0x00, 0x00, LED_BRIGHTNESS, "blue"),
-    COLOR(LED_BRIGHTNESS, LED_BRIGHTNESS, 0x00, "yellow"),
-    COLOR(0x00, LED_BRIGHTNESS, LED_BRIGHTNESS, "cyan"),
-    COLOR(LED_BRIGHTNESS, 0x00, LED_BRIGHTNESS / 2, "pink"),
-    COLOR(LED_BRIGHTNESS / 2, 0x00, LED_BRIGHTNESS, "violet"),
-    COLOR(LED_BRIGHTNESS, LED_BRIGHTNESS, LED_BRIGHTNESS, "white"),
-    COLOR(0x00, 0x00, 0x00, "black"),
+    COLOR(0, LED_BRIGHTNESS, 0x00, 0x00, "red"),
+    COLOR(1, 0x00, LED_BRIGHTNESS, 0x00, "green"),
+    COLOR(2, 0x00, 0x00, LED_BRIGHTNESS, "blue"),
+    COLOR(3, LED_BRIGHTNESS, LED_BRIGHTNESS, 0x00, "yellow"),
+    COLOR(4, 0x00, LED_BRIGHTNESS, LED_BRIGHTNESS, "cyan"),
+    COLOR(5, LED_BRIGHTNESS, 0x00, LED_BRIGHTNESS / 2, "pink"),
+    COLOR(6, LED_BRIGHTNESS / 2, 0x00, LED_BRIGHTNESS, "violet"),
+    COLOR(7, LED_BRIGHTNESS, LED_BRIGHTNESS, LED_BRIGHTNESS, "white"),
+    COLOR(8, 0x00, 0x00, 0x00, "black"),
 };
 
 #define NUM_COLORS (sizeof(color_list) / sizeof(color_list[0]))
@@ -83,6 +224,6 @@ static const color_t color_list[] = {
 #define COLOR_WHITE color_list[7]
 #define COLOR_BLACK color_list[8]
 
-void clearStrip(bool updateStrip);
+#include "led_output.h" // Last, since it uses the definitions above
 
 #endif // _ZBOARD_H
\ No newline at end of file